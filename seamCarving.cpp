@@ -1,7 +1,64 @@
 /* 
     seamCarving.cpp
 
-    run with -> ./a [pgm image file] [# vertical seams to remove] [# horizontal seams to remove]
+    run with -> ./a [pgm image file] [# vertical seams to remove] [# horizontal seams to remove] [options]
+                (a pbm image file, P1 or P4, is carved bit-packed and written back as pbm; only --profile applies)
+           or -> ./a --replay [capture directory]
+           or -> ./a --batch [manifest] [options]   (only --bidirectional, --telemetry, --batch-stats, --image-cache
+                                                    and --cache-energy apply)
+           or -> ./a --atlas [pgm atlas file] [cell width] [cell height] [seams per cell | seam count file] [options]
+           or -> ./a --store-build [store file] [image list]
+           or -> ./a --store-get [store file] [image id] [width] [output pgm file]
+           or -> ./a --coord-query [coordinate map file] to-carved|to-source [x] [y]
+           or -> ./a --benchmark [corpus list] [# vertical seams] [# horizontal seams] [output csv file]
+
+    options:
+        --bidirectional    find each seam with a top-down DP over the upper half of the image and a bottom-up
+                           DP over the lower half, run concurrently and joined at the middle row
+        --interactive      after carving the vertical seams, read commands from stdin to adjust the width:
+                           'width N' carves or restores seams, 'write FILE' saves the image, 'quit' ends
+        --joint FILE       carve FILE with exactly the same seams as the main image, using the energy summed over
+                           all of them (stereo pairs, exposure brackets). repeatable; each is written to its own 
+                           FILE_processed_V_H.pgm
+        --seam-index DIR   keep a perceptual-hash index of carved images and their seams in DIR. an image within 
+                           --seam-index-distance D hash bits (default 6) of one carved before, at exactly the
+                           same size and seam counts (so crops never match), reuses its seams without any DP
+                           provided each seam's energy in this image is within --seam-index-tolerance T (default
+                           0.10) of what it was and of a greedy seam's in this image; otherwise the image is
+                           carved in full
+        --coalesce DIR     share one carve among concurrent invocations with identical input contents and 
+                           arguments: the first carves, the rest wait on it and copy its result. a result is
+                           removed from DIR once every request sharing it has copied it
+        --profile          print the time spent in each stage (load, energy, dp, remove, write)
+        --capture-dir DIR  record any job taking longer than --capture-factor N (default 3) times its predicted
+                           time into a new subdirectory of DIR: copies of the input, energy map, joint images 
+                           and seam index, the input's path and hash, the arguments, the host profile and the
+                           stage timings. the prediction is --capture-ns-per-cell C (default 100) nanoseconds per
+                           energy/DP cell visited. './a --replay DIR/<capture>' reruns a captured job with
+                           --profile on those copies, writing only into the capture
+        --telemetry FILE   write per-seam statistics (energy, column span, drift from the previous seam, energy and
+                           DP cells computed, DP cells pruned) to FILE as csv, or packed binary if FILE ends in .bin
+        --batch-stats FILE with --batch, write per-tenant throughput and latency to FILE as csv
+        --image-cache BYTES with --batch, keep decoded images (keyed by path, size and modification time) in an
+                           LRU cache of up to BYTES, so jobs on the same image parse it once. --cache-energy
+                           caches each image's initial energy map too, saving the first energy pass
+        --coord-map FILE   write the correspondence between source and carved pixel coordinates to FILE, as
+                           run lists per row and column. './a --coord-query FILE to-carved|to-source X Y' maps a
+                           point either way
+        --lazy-energy M    approximate: recompute the energy map in full only every M seams, carving the stale map
+                           along with the image in between without any fix-ups next to the seams. with
+                           --lazy-drift D, also recompute after a seam whose cost differs by more than D (e.g. 0.2)
+                           from the first seam after the last recompute. with --profile, the result is compared
+                           against an exact carve (total seam energy and PSNR)
+        --incremental-dp   exact: after the first seam in each direction, keep the energy and cumulative energy
+                           maps across seams, carving them along with the image and recomputing only the cells
+                           the removed seam can have changed. each seam is the one a full DP would have found
+        --energy FILE      carve using a precomputed energy (or saliency) map instead of the pixel gradient. 
+                           FILE is a P2 pgm or a greyscale (Pf) pfm of the same size as the image; it is carved 
+                           along with the image rather than recomputed for every seam
+        --energy-scale S   multiply pfm energy values by S before rounding them to integers (default 1)
+        --energy-update M  how the precomputed energy next to each removed seam is updated: 'freeze' leaves it 
+                           as-is (default), 'blend' averages it with the recomputed pixel gradient
 
     seam carving changes the size of an image by removing the least visible pixels in the image. 
     the visibility of a pixel can be defined using an energy function. Seam carving can be done by finding a 
@@ -31,6 +88,55 @@
 #include <cmath> 
 #include <algorithm>
 #include <utility> 
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <limits>
+#include <cctype>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <map>
+#include <atomic>
+#include <memory>
+#include <ctime>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+// TRACING
+// static tracepoints (USDT) for attaching bpftrace / perf to a running carve, ex)
+//     bpftrace -e 'usdt:./a:seamcarving:seam__end { @us = hist((nsecs - @start[tid]) / 1000); }
+//                  usdt:./a:seamcarving:seam__start { @start[tid] = nsecs; }'
+// enabled by configuring with -DSEAMCARVING_USDT=ON (needs <sys/sdt.h>, from systemtap-sdt-dev). 
+// otherwise each probe compiles to nothing.
+#ifdef SEAMCARVING_USDT
+#include <sys/sdt.h>
+#define TRACE_PROBE(name) DTRACE_PROBE(seamcarving, name)
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(seamcarving, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(seamcarving, name, a, b)
+#define TRACE_PROBE3(name, a, b, c) DTRACE_PROBE3(seamcarving, name, a, b, c)
+#else
+#define TRACE_PROBE(name) do {} while (0)
+#define TRACE_PROBE1(name, a) do {} while (0)
+#define TRACE_PROBE2(name, a, b) do {} while (0)
+#define TRACE_PROBE3(name, a, b, c) do {} while (0)
+#endif
 
 using std::cout;
 using std::cerr;
@@ -42,588 +148,5563 @@ using std::vector;
 using std::string;
 using std::stringstream;
 
+// OPTIONS
+
+// how an energy map carved along with its image is updated around each removed seam
+enum EnergyUpdate
+{
+    ENERGY_RECOMPUTE, // recompute the L1 gradient energy of the pixels next to the seam
+    ENERGY_FREEZE,    // leave the remaining energy values untouched
+    ENERGY_BLEND      // average the existing energy with the L1 gradient energy next to the seam
+};
+
+// optional flags accepted after the three positional arguments
+struct CarveOptions
+{
+    bool bidirectional = false;                 // --bidirectional   : meet-in-the-middle DP on two threads
+    bool interactive = false;                   // --interactive     : read resize commands from stdin
+    string energyFile;                          // --energy FILE     : precomputed energy map (PGM or PFM) to carve instead of the gradient
+    double energyScale = 1.0;                   // --energy-scale S  : multiplier applied to PFM energy values
+    EnergyUpdate energyUpdate = ENERGY_FREEZE;  // --energy-update M : freeze or blend, for a precomputed energy map
+    vector<string> jointFiles;                  // --joint FILE      : aligned images carved with the same seams (repeatable)
+    string seamIndexDir;                        // --seam-index DIR  : reuse the seams of near-duplicate images carved before
+    int seamIndexDistance = 6;                  // --seam-index-distance D  : max perceptual hash bits differing for a match
+    double seamIndexTolerance = 0.10;           // --seam-index-tolerance T : max relative rise in a reused seam's energy
+    string coalesceDir;                         // --coalesce DIR    : share one carve among concurrent identical invocations
+    bool profile = false;                       // --profile         : print the time spent in each stage
+    string captureDir;                          // --capture-dir DIR : record jobs slower than predicted for --replay
+    double captureFactor = 3.0;                 // --capture-factor N       : capture jobs taking over N times their predicted time
+    double captureNsPerCell = 100.0;            // --capture-ns-per-cell C  : predicted cost of one energy + DP cell, in ns
+    string telemetryFile;                       // --telemetry FILE  : per-seam statistics, as csv (or binary if FILE ends in .bin)
+    string batchStatsFile;                      // --batch-stats FILE : per-tenant throughput and latency of a --batch run, as csv
+    string coordMapFile;                        // --coord-map FILE  : where each carved pixel came from, for mapping points either way
+    long long imageCacheBytes = 0;              // --image-cache BYTES : with --batch, keep up to BYTES of decoded images in memory
+    bool cacheEnergy = false;                   // --cache-energy    : with --image-cache, cache each image's initial energy map too
+    int lazyEnergy = 0;                         // --lazy-energy M   : recompute the energy map only every M seams, carrying it along in between
+    double lazyDrift = 0;                       // --lazy-drift D    : with --lazy-energy, also recompute once a seam's cost drifts by D (relative)
+    bool incrementalDP = false;                 // --incremental-dp  : repair the cumulative energy map around each removed seam instead of redoing it
+};
+
+// wall-clock seconds spent in each stage of a carve
+struct StageTimings
+{
+    double load = 0;    // parsing the input image(s)
+    double energy = 0;  // energy maps
+    double dp = 0;      // cumulative energy maps and seam trace-back
+    double remove = 0;  // removing seams
+    double write = 0;   // writing the result
+};
+
+// a seam as carved, with its total energy at the time it was carved
+struct SeamRecord
+{
+    bool horizontal;        // carved from the transposed image
+    long long energy;       // total energy along the seam
+    vector<int> columns;    // column index of the seam pixel in each row (of the transposed image if horizontal)
+};
+
+// what carveSeams reports back about a carve
+struct CarveReport
+{
+    bool logSeams = false;      // whether to fill 'seams'
+    vector<SeamRecord> seams;   // every seam carved, in order
+    StageTimings timings;       // time spent in the energy, dp and remove stages
+    class CoordinateMap *coordinates = nullptr; // if not null, updated with every seam carved
+    int energyRecomputes = 0;   // full energy map computations
+};
+
+CarveOptions parseCarveOptions(int argc, char* argv[], int first = 4);
+
 // CORE 
 
 vector<vector<int>> initImageMap(const string &filename);
+bool loadImageMap(const string &filename, vector<vector<int>> &imageMap, string &problem);
+void readPgmHeader(ifstream &pgmInputFile, const string &filename, int &columns, int &rows, int &maxPixelValue);
+bool parsePgmHeader(ifstream &pgmInputFile, const string &filename, int &columns, int &rows, int &maxPixelValue, string &problem);
+vector<vector<int>> initImageMapFused(const string &filename, vector<vector<int>> &energyMap, vector<vector<int>> &cumulativeEnergyMap);
 vector<vector<int>> initEnergyMap(const vector<vector<int>> &imageMap);
+int pixelEnergy(const vector<vector<int>> &imageMap, int i, int j);
+vector<vector<int>> initJointEnergyMap(const vector<vector<int>> &imageMap, const vector<vector<vector<int>>> &jointMaps);
+vector<vector<int>> loadEnergyMap(const string &filename, double scale, const vector<vector<int>> &imageMap);
+int refreshEnergyNearSeam(const vector<vector<int>> &imageMap, vector<vector<int>> &energyMap, const vector<int> &seam, EnergyUpdate update = ENERGY_RECOMPUTE);
+void seamNeighborhood(const vector<int> &seam, int i, int columns, int &low, int &high);
 vector<vector<int>> initCumulativeEnergyMap(const vector<vector<int>> &energyMap);
+long long repairCumulativeEnergyMap(const vector<vector<int>> &energyMap, vector<vector<int>> &cumulativeEnergyMap, const vector<int> &seam);
 void seamCarver(vector<vector<int>> &imageMap, const vector<vector<int>> &cumulativeEnergyMap);
+vector<int> findSeam(const vector<vector<int>> &cumulativeEnergyMap);
+vector<int> findSeamBidirectional(const vector<vector<int>> &energyMap);
+vector<int> findLowestEnergySeam(const vector<vector<int>> &energyMap, const CarveOptions &options);
+void removeSeam(vector<vector<int>> &map, const vector<int> &seam);
+void removeSeamJoint(vector<vector<int>> &imageMap, vector<vector<vector<int>>> &jointMaps, const vector<int> &seam);
+vector<int> extractSeam(vector<vector<int>> &map, const vector<int> &seam);
+void insertSeam(vector<vector<int>> &map, const vector<int> &seam, const vector<int> &values);
 
-// HELPERS
+void carveSeams(vector<vector<int>> &I, vector<vector<vector<int>>> &J, vector<vector<int>> &E, 
+                int num_vertical_seams, int num_horizontal_seams, const CarveOptions &options, CarveReport &report, 
+                const vector<vector<int>> *loadedCE = nullptr);
+double secondsSince(std::chrono::steady_clock::time_point start);
+long long seamEnergy(const vector<vector<int>> &energyMap, const vector<int> &seam);
+long long exactSeamsEnergy(vector<vector<int>> imageMap, const vector<SeamRecord> &seams);
 
-void transposeMap(vector<vector<int>> &imageMap);
-void displayMap(const vector<vector<int>> &map);
-void displayTranspose(const vector<vector<int>> &map);
-void validateCarveRequests(const vector<vector<int>> &imageMap, int num_vertical_seams, int num_horizontal_seams);
-void writeResults(const vector<vector<int>> &imageMap, const string &filename);
+// SEAM INDEX
 
-int main(int argc, char* argv[]) 
+unsigned long long perceptualHash(const vector<vector<int>> &imageMap);
+bool findNearDuplicate(const string &directory, unsigned long long hash, const vector<vector<int>> &imageMap, 
+                       int num_vertical_seams, int num_horizontal_seams, int maxDistance, vector<SeamRecord> &seams);
+bool replaySeams(vector<vector<int>> &imageMap, const vector<SeamRecord> &seams, double tolerance);
+long long greedySeamEnergy(const vector<vector<int>> &energyMap);
+void addToSeamIndex(const string &directory, unsigned long long hash, int columns, int rows, 
+                    int num_vertical_seams, int num_horizontal_seams, const vector<SeamRecord> &seams);
+
+// COALESCING
+
+unsigned long long hashFile(const string &filename, unsigned long long hash);
+string coalesceKey(int argc, char* argv[], const CarveOptions &options);
+bool coalesceAcquire(const string &directory, const string &key, const string &fileToWrite);
+void coalescePublish(const string &directory, const string &key, const string &fileToWrite);
+
+// SESSION
+
+// a carved seam, remembered along with the pixels it took so it can be put back exactly
+struct RemovedSeam
 {
-    cout << " ______________________________________________________\n";
-    cout << "|                                                      |\n";
-    cout << "| 3460:435/535 Algorithms Project Three - Seam Carving |\n";
-    cout << "|______________________________________________________|\n\n";
+    vector<int> columns; // column index of the seam pixel in each row
+    vector<int> pixels;  // original value of the seam pixel in each row
+    vector<int> energy;  // energy of the seam pixel in each row when it was carved
+    vector<vector<int>> neighborEnergy; // energy of each row's seamNeighborhood before refreshEnergyNearSeam updated it
+};
 
-    // VALIDATE ARGUMENTS
-    if(argc != 4) 
-    {
-        cerr << "error: invalid command-line arguments\n"
-             << "format of valid program invocation: ./a [pgm image file] [# vertical seams to remove] [# horizontal seams to remove]\n";
-        exit(1);
-    }
+// an image whose width can be adjusted back and forth interactively. narrowing carves seams from a maintained
+// energy map and cumulative energy map, the latter computed once and then repaired around each new seam;
+// widening puts previously carved seams back without any DP, and narrowing again over that range re-removes
+// those same seams without any DP either. putting a seam back or re-removing it touches the O(rows) cells of
+// the seam and its neighbors, plus one shift of each row's tail.
+class CarvingSession
+{
+public:
+    CarvingSession(const vector<vector<int>> &imageMap, const vector<vector<int>> &energyMap, const CarveOptions &options);
 
-    // INITIALIZE THE IMAGE MAP 
-    string fullname = string(argv[1]);
-    vector<vector<int>> I = initImageMap(fullname);
+    int width() const;
+    int originalWidth() const;
+    const vector<vector<int>> &image() const;
 
-    // validate command-line args for vertical/horizontal carve requests
-    int num_vertical_seams = atoi(argv[2]);
-    int num_horizontal_seams = atoi(argv[3]);
-    validateCarveRequests(I, num_vertical_seams, num_horizontal_seams);
+    void shrink();
+    bool grow();
+    void resize(int width);
 
-    // cout << "'" << argv[1] << "' --> Initial Image Map:\n";
-    // displayMap(I);
+private:
+    void remove(const RemovedSeam &seam);
 
-    // CARVE THE REQUESTED NUMBER OF VERTICAL SEAMS
-    for (int i = 1; i <= num_vertical_seams; ++i)
-    {
-        cout << "\n[C][A][R][V][I][N][G] [V[E][R][T][I][C][A][L] [S][E][A][M] [" << i << "]\n";
+    vector<vector<int>> imageMap;
+    vector<vector<int>> energyMap;  // kept in step with imageMap
+    vector<vector<int>> cumulativeEnergyMap; // of the narrowest image so far (no seams to redo), empty until the first new seam
+    vector<RemovedSeam> undoSeams;  // seams carved out, most recent last
+    vector<RemovedSeam> redoSeams;  // seams put back by grow, most recent last
+    CarveOptions options;
+    int fullWidth;
+};
 
-        // cout << "\nInitial Image Map:\n";
-        // displayMap(I);
+void runInteractiveSession(const vector<vector<int>> &imageMap, const vector<vector<int>> &energyMap, int num_vertical_seams, const CarveOptions &options);
 
-        // INITIALIZE THE ENERGY MAP
-        vector<vector<int>> E = initEnergyMap(I);
-        
-        // cout << "\nEnergy Map: \n";
-        // displayMap(E);
+// RESOURCES
 
-        // INITIALIZE THE CUMULATIVE ENERGY MAP 
-        vector<vector<int>> CE = initCumulativeEnergyMap(E);
+// the CPU and memory actually available to this process, which inside a container may be far less than the host has
+struct ResourceLimits
+{
+    int cpus;               // usable CPUs: the least of the hardware threads, the affinity mask / cpuset, and the CPU quota
+    long long memoryBytes;  // memory limit, or -1 if unlimited
+};
 
-        // cout << "\nCumulative Energy Map: \n";
-        // displayMap(CE);
+const ResourceLimits &detectResourceLimits();
+int countCpuList(const string &cpuList);
+long long estimateWorkingSet(int columns, int rows, int jointCount, const CarveOptions &options);
+template <typename First, typename Second> void runConcurrently(First first, Second second, bool worthAThread = true);
 
-        // CARVE OUT A SEAM
-        seamCarver(I, CE); 
+// cells below which a cumulative energy pass is cheaper than starting and joining a thread to split it
+const long long CONCURRENT_DP_CELLS = 1 << 17;
 
-        // cout << "\nSeam-Carved Image Map: \n";
-        // displayMap(I);
+/// @brief Run two pieces of work at the same time, one on a new thread and one on the calling thread, 
+///        or one after the other if only one CPU is available.
+/// @param first Work to run, on the new thread.
+/// @param second Work to run, on the calling thread.
+/// @param worthAThread False if the work is too small to pay for a thread, to run it one after the other.
+template <typename First, typename Second>
+void runConcurrently(First first, Second second, bool worthAThread)
+{
+    if (!worthAThread || detectResourceLimits().cpus < 2)
+    {
+        first();
+        second();
+        return;
     }
 
-    // CARVE THE REQUESTED NUMBER OF HORIZONATL SEAMS
-    if (num_horizontal_seams > 0)
-    {    
-        // if-block protects against unecessarily transposing the image map
+    std::thread worker(first);
+    second();
+    worker.join();
+}
 
-        transposeMap(I); // transpose the map to reuse the vertical seam carver for horizontal seams
-        for (int i = 1; i <= num_horizontal_seams; ++i)
+// LAYOUT
+
+// a one-time conversion between layouts (a transpose, a repacking) is split into square tiles, small enough that
+// a source tile and its destination tile stay in cache together, and the tiles are shared out among the CPUs.
+// the tile edge is also the word size of a BitImage, so bit-packed tiles are whole words.
+const int LAYOUT_TILE = 64;
+
+template <typename Work> void runTiles(int rows, int columns, Work work, int threads = 0);
+void transposeBlock(const vector<vector<int>> &source, vector<vector<int>> &destination, int top, int left, int rows, int columns);
+void transposeBits64(uint64_t block[64]);
+
+/// @brief Run a conversion over a rows x columns layout tile by tile, on up to one thread per available CPU. Small
+///        conversions, where starting threads would cost more than they save, run on the calling thread.
+/// @param rows Rows of the source layout.
+/// @param columns Columns of the source layout.
+/// @param work Called as work(top, left, tileRows, tileColumns) once for each tile, on any thread. Tiles are
+///             disjoint, so work writing only its own tile's destination needs no locking.
+/// @param threads Most threads to use, the calling thread included, or 0 for one per available CPU. Callers
+///                already running on one of several worker threads pass their share (1 for a batch worker),
+///                so a pool of workers does not start a pool of threads each.
+template <typename Work>
+void runTiles(int rows, int columns, Work work, int threads)
+{
+    int tileRows = (rows + LAYOUT_TILE - 1) / LAYOUT_TILE, tileColumns = (columns + LAYOUT_TILE - 1) / LAYOUT_TILE;
+    int tiles = tileRows * tileColumns;
+    threads = threads > 0 ? threads : detectResourceLimits().cpus;
+    threads = (long long)rows * columns >= (1 << 18) ? std::min(threads, tiles) : 1;
+
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int t = next++; t < tiles; t = next++)
         {
-            cout << "\n[C][A][R][V][I][N][G] [H[O][R][I][Z][O][N][T][A][L] [S][E][A][M] [" << i << "]\n";
+            int top = t / tileColumns * LAYOUT_TILE, left = t % tileColumns * LAYOUT_TILE;
+            work(top, left, std::min(LAYOUT_TILE, rows - top), std::min(LAYOUT_TILE, columns - left));
+        }
+    };
 
-            // cout << "\nInitial Image Map:\n";
-            // displayTranspose(I);
+    vector<std::thread> workers;
+    for (int w = 1; w < threads; ++w)
+    {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : workers)
+    {
+        thread.join();
+    }
+}
 
-            // INITIALIZE THE ENERGY MAP
-            vector<vector<int>> E = initEnergyMap(I);
-            
-            // cout << "\nEnergy Map: \n";
-            // displayTranspose(E);
+// TELEMETRY
 
-            // INITIALIZE THE CUMULATIVE ENERGY MAP 
-            vector<vector<int>> CE = initCumulativeEnergyMap(E);
+// statistics for one carved seam, for tuning the approximate and incremental modes
+struct SeamTelemetry
+{
+    int thread;             // telemetry buffer (one per carving thread) the record came from
+    int horizontal;         // 1 if carved from the transposed image
+    int seam;               // seam number within its orientation, from 1
+    long long energy;       // total energy along the seam
+    int span;               // columns between the seam's leftmost and rightmost pixels
+    int drift;              // largest column difference from the previous seam in any row (-1 for the first seam)
+    long long energyCells;  // energy cells computed for this seam (a full pass, or an incremental refresh)
+    long long dpCells;      // cumulative energy cells computed for this seam
+    long long prunedCells;  // cumulative energy cells skipped as provably unchanged
+};
 
-            // cout << "\nCumulative Energy Map: \n";
-            // displayTranspose(CE);
+vector<SeamTelemetry> &threadTelemetry();
+void recordSeamTelemetry(bool horizontal, int index, long long energy, const vector<int> &seam, const vector<int> &previousSeam, 
+                         long long energyCells, long long dpCells, long long prunedCells);
+void writeTelemetry(const string &filename);
 
-            // CARVE OUT A SEAM
-            seamCarver(I, CE); 
+// BATCH
 
-            // cout << "\nSeam-Carved Image Map: \n";
-            // displayTranspose(I);
-        }
-        transposeMap(I); // undo the transpose
-    }
+// a tenant sharing a batch run. worker time is shared between tenants in proportion to their weights, 
+// measured in pixel-seams (each seam costs the pixel count of the image it is carved from)
+struct BatchTenant
+{
+    string name;
+    double weight = 1.0;
+    int maxConcurrent = 0;          // most of its jobs carved at once (0 = no cap)
+    long long maxMemory = -1;       // most memory its started jobs may hold (-1 = no cap)
 
-    // WRITE RESULTS TO FILE
+    double virtualTime = 0;         // pixel-seams served, divided by weight. the lowest is served next
+    long long pixelSeams = 0;       // pixel-seams served
+    int running = 0;                // its jobs being carved right now
+    long long memoryInUse = 0;      // working set of its started, unfinished jobs
+    std::deque<int> queue;          // its jobs awaiting their next seam: started jobs first, then in manifest order
+    vector<double> latencies;       // seconds from the start of the run to each job's completion
+    int failed = 0;                 // jobs that could not be carved
+};
 
-    // get the raw file name
-    string rawname = fullname.substr(0, fullname.find_last_of("."));
+// one image to carve in a batch run, carved one seam per turn
+struct BatchJob
+{
+    int tenant = 0;
+    string filename;
+    int verticalSeams = 0;
+    int horizontalSeams = 0;
 
-    // derive file name to write to (./a example.pgm 10 5  --->  example_processed_10_5.pgm)
-    string fileToWrite = rawname + "_processed_" + std::to_string(num_vertical_seams) + "_" + std::to_string(num_horizontal_seams) + ".pgm";
+    bool started = false;           // image loaded, memory charged to its tenant
+    bool transposed = false;        // carving horizontal seams
+    int seamsCarved = 0;
+    long long memory = 0;           // estimated working set
+    vector<vector<int>> imageMap;
+    vector<vector<int>> energyMap;  // energy map for the first seam, if it came from the image cache
+    vector<int> previousSeam;       // the last seam carved in the current orientation, for --telemetry
+};
 
-    // write the processed image to fileToWrite
-    writeResults(I, fileToWrite);
+void runBatch(const string &manifest, const CarveOptions &options);
+bool readPgmDimensions(const string &filename, int &columns, int &rows);
+long long carveBatchSeam(BatchJob &job, const CarveOptions &options);
 
-    cout << "\nEND PROCESSING\n";
-    cout << "Results written to '" << fileToWrite << "' \n";
-    
-    return 0;
-}
+// IMAGE CACHE
 
-/// @brief A 2D vector of integers is populated with the image pixel values comprising the pgm image file, 'filename'.
-/// @param filename Name of a file with a pgm extension.
-/// @return The resultant image map by value.
-/// @note initImageMap assumes the pgm file format outlined in the project description is rigorously adhered to. 
-///       Noteably, a hard assumption is made that one optional comment is in the file, necessarily on line two (if it exists).
-vector<vector<int>> initImageMap(const string &filename)
+// a decoded image as kept by ImageCache
+struct CachedImage
 {
-    ifstream pgmInputFile(filename);
- 
-    // validate good connection to the input file
-    if (!pgmInputFile) 
-    {
-        cerr << "error: could not open file '" << filename << "'\n"
-             << "check the file name is correct and the file is located at the same directory level as the executable\n";
-        exit(1);
-    }
+    vector<vector<int>> imageMap;
+    vector<vector<int>> energyMap;  // its initial energy map, if the cache keeps those; else empty
+    long long bytes = 0;            // memory held
+};
 
-    // #REGION parse_to_data 
-    string temp_line;
-    
-    // handle file format line
-    getline(pgmInputFile, temp_line); // "P2"
-    if (temp_line != "P2") 
-    { 
-        // this program handles only P2 images, meaning colors must be in greyscale
-        cerr << "error: invalid pgm file format\n"
-             << "file format was read as '" << temp_line << "', while the supported format is 'P2' for a PGM file\n";
-        exit(1);
-    }
+// an in-memory LRU cache of decoded images shared by the workers of a batch run, so that an image many jobs
+// carve to different sizes is parsed, and optionally has its initial energy map computed, only once
+class ImageCache
+{
+public:
+    ImageCache(long long maxBytes, bool withEnergy);
 
-    // @NOTE - crucially, the code here assumes line two of the header is the singular comment-line, or there are no comments in the file at all
-    if (pgmInputFile.peek() == '#') 
-    { 
-        getline(pgmInputFile, temp_line); // skip optional comment
-    }
+    std::shared_ptr<const CachedImage> load(const string &filename, string &problem);
+    long long hits() const;
+    long long misses() const;
 
-    getline(pgmInputFile, temp_line); // columns X rows
+private:
+    typedef std::list<std::pair<string, std::shared_ptr<const CachedImage>>> Entries;
 
-    // parse out the column and row count from this line
-    int columns = 0, rows = 0;
-    stringstream dimensions;      
-    dimensions << temp_line;       // read entire line into string stream
-    dimensions >> columns >> rows; // write whitespace seperated values into variables
+    std::mutex mutex;
+    Entries entries;                                // most recently used first
+    std::map<string, Entries::iterator> index;      // by path, size and modification time
+    long long maxBytes;
+    long long bytes = 0;
+    bool withEnergy;
+    long long hitCount = 0, missCount = 0;
+};
 
-    // something went wrong if these are still 0
-    if (columns == 0 || rows == 0)
-    {
-        // an error occured in reading the image dimensions
-        cerr << "error: a problem occured in reading the pgm file dimensions\n"
-             << "please ensure the data format outlined in the project description is strictly adhered to \n";
-        exit(1);
-    }
+// ATLAS
 
-    getline(pgmInputFile, temp_line); // maximum greyscale value
-    int maxPixelValue = stoi(temp_line);
-    // #ENDREGION
+// one grid cell of an atlas, carved in place inside the atlas rows
+struct AtlasCell
+{
+    int top, left;          // of the cell, in the atlas
+    int columns, rows;      // current size of the cell; columns shrinks as seams are carved
+    int seams;              // vertical seams to carve from it
+};
 
-    // #REGION parse_data
-    // read raw pixel data into a string, and subsequently into a stringstream
-    string pixelData;
-    stringstream ssPixelData;
-    while (!pgmInputFile.eof())
-    {
-        // grab a row of data
-        getline(pgmInputFile, temp_line); 
+void runAtlas(const string &filename, int cellColumns, int cellRows, const string &seams, const CarveOptions &options);
+void carveAtlasCell(vector<vector<int>> &atlas, AtlasCell &cell, vector<int> &energy, vector<int> &cumulative);
 
-        // if temp_line does not end in a whitespace we will append one ourself 
-        if (temp_line[temp_line.size() - 1] != ' ')
-        {
-            temp_line.append(" ");
-        }
+// BILEVEL
 
-        // append to the result string
-        pixelData += temp_line;
-    }
-    ssPixelData << pixelData;
+// a bilevel (pbm) image, packed 64 pixels to a word. pixel j of row i is bit j % 64 of word j / 64 of the row,
+// and the bits past the last column are kept clear
+struct BitImage
+{
+    int columns = 0, rows = 0;
+    int words = 0;              // words allocated per row
+    bool binary = false;        // read as (and so written as) P4 rather than P1
+    vector<uint64_t> bits;      // rows * words
 
-    // populate a 2D vector with the data
-    vector<vector<int>> result;
-    int pixel = 0;
-    for (int i = 0; i < rows; ++i)
-    {
-        // outer-for iterates over rows
+    uint64_t *row(int i) { return &bits[(size_t)i * words]; }
+    const uint64_t *row(int i) const { return &bits[(size_t)i * words]; }
+    int pixel(int i, int j) const { return (row(i)[j / 64] >> (j % 64)) & 1; }
+};
 
-        vector<int> rowResult;
-        for (int j = 0; j < columns; ++j)
-        {
-            // inner-for iterates over individual pixels in each row
-            ssPixelData >> pixel;
+bool isPbmFile(const string &filename);
+BitImage loadBitImage(const string &filename);
+void writeBitImage(const BitImage &image, const string &filename);
+void initBitEnergyMap(const BitImage &image, vector<uint8_t> &energyMap);
+template <typename Cost>
+vector<int> findBitSeam(const vector<uint8_t> &energyMap, int columns, int rows, vector<Cost> &cumulativeEnergyMap);
+void removeBitSeam(BitImage &image, const vector<int> &seam);
+BitImage transposeBitImage(const BitImage &image);
+void carveBitImage(BitImage &image, int num_vertical_seams, int num_horizontal_seams, StageTimings &timings);
 
-            // ensure the pixel is within the valid range of values
-            if (pixel > maxPixelValue || pixel < 0)
-            {
-                cerr << "error: a pixel value exists in the image data which falls outside the given acceptable range of [0, " << maxPixelValue << "]\n";
-                exit(1);
-            }
-            
-            rowResult.push_back(pixel);
-        }
-        
-        result.push_back(rowResult);
-    }
-    // #ENDREGION
+// RETARGET STORE
 
-    return result;
-}
+// a packed file of many images, each with its precomputed vertical seam-removal order, from which any image 
+// can be produced at any stored width by a single filtering pass over memory-mapped data. layout (host byte order):
+//     header                  RetargetStoreHeader
+//     index                   RetargetStoreEntry[count], sorted by id
+//     per image, at offset    uint16 pixels[height][width], then uint16 removedBy[height][width]
+// removedBy holds, for each pixel, the number (from 1) of the seam that removed it, or RETARGET_KEPT if none did.
+// narrowing an image by k columns keeps exactly the pixels whose removedBy exceeds k.
+struct RetargetStoreHeader
+{
+    char magic[8];          // "SCSTORE1"
+    uint32_t count;         // number of images
+    uint32_t reserved;
+};
 
-/// @brief A 2D vector of integers is populated with pixel energy values using an image map produced by initImageMap.
-/// @param imageMap A 2D vector containing the pixel data of a pgm file
-/// @return The resultant energy map by value.
-vector<vector<int>> initEnergyMap(const vector<vector<int>> &imageMap)
+struct RetargetStoreEntry
 {
-    vector<vector<int>> result;
-    for (int i = 0; i < imageMap.size(); ++i)
-    {
-        // outer-for iterates over rows
+    char id[64];            // null-terminated image id
+    uint64_t offset;        // of the image's pixels, from the start of the file
+    uint32_t width;
+    uint32_t height;
+    uint32_t maxSeams;      // the image can be narrowed by up to this many columns
+    uint32_t maxValue;      // the image's maximum pixel value
+};
 
-        vector<int> rowResult;
-        for (int j = 0; j < imageMap[i].size(); ++j) 
-        {
-            // inner-for iterates over individual pixels in each row
-            
-            // #REGION find ΔI along X axis 
-            // bounds checking X
-            int left = (j - 1) >= 0 ? imageMap[i][j - 1] : imageMap[i][j]; 
-            int right = (j + 1) < imageMap[i].size() ? imageMap[i][j + 1] : imageMap[i][j];
+const uint16_t RETARGET_KEPT = 0xFFFF;
 
-            int changeX = abs(imageMap[i][j] - left) + abs(imageMap[i][j] - right);
-            // #ENDREGION
+// read-only view of a retarget store
+class RetargetStore
+{
+public:
+    RetargetStore();
+    ~RetargetStore();
 
-            // #REGION find ΔI along Y axis 
-            // bounds checking Y
-            int up = (i - 1) >= 0 ? imageMap[i - 1][j] : imageMap[i][j];
-            int down = (i + 1) < imageMap.size() ? imageMap[i + 1][j] : imageMap[i][j];
+    bool open(const string &filename);
+    const RetargetStoreEntry *find(const string &id) const;
+    bool retarget(const string &id, int width, vector<vector<int>> &result) const;
 
-            int changeY = abs(imageMap[i][j] - up) + abs(imageMap[i][j] - down);
-            // #ENDREGION
-            
-            // store the energy of the pixel
-            rowResult.push_back(changeX + changeY);
-        }
+private:
+    RetargetStore(const RetargetStore &);
+    RetargetStore &operator=(const RetargetStore &);
 
-        result.push_back(rowResult);
-    }
-    
-    return result;
-}
+    const unsigned char *data;
+    size_t size;
+    const RetargetStoreEntry *entries;
+    uint32_t count;
+};
 
-/// @brief A 2D vector of integers is populated with cumulative energy values using an energy matrix.
-/// @param energyMap The energy map which is used to derive the CE map.
-/// @return The resultant cumulative energy map by value.
-/// @note The lowest energy value in the final row of a CE matrix represents the pixel 
-///       which ends the lowest energy seam.
-vector<vector<int>> initCumulativeEnergyMap(const vector<vector<int>> &energyMap)
+void buildRetargetStore(const string &storeFile, const string &listFile);
+vector<vector<int>> seamRemovalOrder(const vector<vector<int>> &imageMap, int maxSeams);
+
+// COORDINATE MAP
+
+// where each pixel of a carved image came from. each row of the source keeps its surviving columns as a list of
+// runs, each run a stretch of consecutive source columns and the carved column it starts at (a prefix sum of the
+// run lengths before it); its length is implied by where the next run, or the row, ends. horizontal seams, carved
+// after the vertical ones, are kept the same way for each column of the vertically carved image. removing a seam
+// splits or trims one run per line, and a point is mapped either way with a binary search per stage.
+class CoordinateMap
 {
-    // initialize result with the contents of the energyMap
-    vector<vector<int>> result (energyMap);
+public:
+    CoordinateMap() {}
+    CoordinateMap(int columns, int rows);
 
-    /*  objective: for each pixel, act as though this is the end of the seam.
-                   write to result at this indexed pixel, the "cumulative energy"
-                   of itself and the pixel it would have come from. 
-        EX: X comes from 1 (the lowest energy ancestor)
-        +---+---+---+---+
-        | 1 | 2 | 3 | 4 |
-        +---+---+---+---+
-        |   | X |   |   |
-        +---+---+---+---+
+    void removeSeam(bool horizontal, const vector<int> &seam);
+    bool toCarved(int x, int y, int &carvedX, int &carvedY) const;
+    void toSource(int carvedX, int carvedY, int &x, int &y) const;
 
-        from the perspective of X, we are looking at ... 
-            energyMap[i - 1][j - 1], energyMap[i - 1][j], and energyMap[i - 1][j + 1]
-        
-        bounds checking will need to be done on j
-    */
+    void write(const string &filename) const;
+    bool read(const string &filename);
 
-    for (int i = 1; i < result.size(); ++i)
+    int sourceColumns = 0, sourceRows = 0;
+    int carvedColumns = 0, carvedRows = 0;
+
+private:
+    struct Run
     {
-        // outer-for iterates over rows (begin iterating on second row)
+        int source;     // first source column (or row) of the run
+        int carved;     // where it is in the carved line
+    };
 
-        for (int j = 0; j < result[i].size(); ++j) 
-        {
-            // inner-for iterates over individual pixels in each row
-            
-            //#REGION bounds checking
-            // create a list of up to 3 (or 2) seam origin pixels in the row above that can be connected
-            // to the seam pixel in the current row.
-            vector<int> nextSeamPixelCandidates;
+    static void removeFromLine(vector<Run> &line, int length, int position);
+    static bool lineToCarved(const vector<Run> &line, int length, int source, int &carved);
+    static int lineToSource(const vector<Run> &line, int carved);
 
-            // validate bounds of upper-left
-            if ((j - 1) >= 0) 
-            { 
-                nextSeamPixelCandidates.push_back(result[i - 1][j - 1]);
-            }
+    vector<vector<Run>> rowRuns;     // per source row: surviving source columns
+    vector<vector<Run>> columnRuns;  // per column of the vertically carved image: surviving rows (empty if no horizontal seams)
+};
 
-            // no need to validate upper
-            nextSeamPixelCandidates.push_back(result[i - 1][j]);
+// BENCHMARK
 
-            // validate bounds of upper-right
-            if ((j + 1) < energyMap[i].size()) 
-            { 
-                nextSeamPixelCandidates.push_back(result[i - 1][j + 1]);
-            }
-            //#ENDREGION
-
-            // at this pixel, add to its energy the minimum energy contained within nextSeamPixelCandidates
-            result[i][j] += *std::min_element(nextSeamPixelCandidates.begin(), nextSeamPixelCandidates.end());
-        }
-    }
+// a carving strategy compared by runBenchmark
+struct BenchmarkStrategy
+{
+    string name;
+    CarveOptions options;
+};
 
-    return result;
-}
+vector<BenchmarkStrategy> benchmarkStrategies();
+vector<string> unimplementedBenchmarkStrategies();
+void runBenchmark(const string &corpus, int num_vertical_seams, int num_horizontal_seams, const string &csvFile);
 
-/// @brief Given the image map and its cumulative energy map, "carve out" the lowest energy seam 
-///        from the image map.
-/// @param imageMap The image map to be modified by the seamCarver.
-/// @param cumulativeEnergyMap The CE map to be traced-back to determine the lowest energy seam.
-void seamCarver(vector<vector<int>> &imageMap, const vector<vector<int>> &cumulativeEnergyMap)
-{
-    // modify imageMap by identifying the pixel in each row that is an element of the 
-    // lowest energy seam, shifting it the end of the row, and popping back that element to carve out the seam
+// CAPTURE
 
-    // each element of seam_column_indices corresponds to a row in the image map, 
-    // and contains the column index of the seam pixel in that row.
-    int seam_column_indices[cumulativeEnergyMap.size()] = { -1 }; 
+long long predictedCells(int columns, int rows, int num_vertical_seams, int num_horizontal_seams);
+void captureSlowJob(const string &directory, int argc, char* argv[], const StageTimings &timings, double seconds, double predictedSeconds);
+void replayCapturedJob(const string &directory, const char *executable);
+void displayTimings(const StageTimings &timings, double seconds);
 
-    // get the index of the seam-ending pixel and put at the end of the seam pixel list
-    // the seam-ending pixel is the element in the final row of the cumulativeEnergyMap with the lowest energy
-    int num_rows = cumulativeEnergyMap.size();                                                                                
-    auto seam_end_itr = std::min_element(cumulativeEnergyMap[num_rows - 1].begin(), cumulativeEnergyMap[num_rows - 1].end()); 
-    int seam_end_index = std::distance(cumulativeEnergyMap[num_rows - 1].begin(), seam_end_itr);                              
-    seam_column_indices[num_rows - 1] = seam_end_index;
+// HELPERS
 
-    // iterate in reverse-row order, descending the seam
-    // for each iteration, first remove the seam pixel for that row 
-    // and next trace-back the seam to find the index of the seam pixel connected to it for the next iteration
-    for (int i = cumulativeEnergyMap.size() - 1; i >= 0; --i)
-    {
-        //#REGION remove the seam_pixel for this row
-        // Remove the seam pixel from the current row by swapping it with adjacent pixels
-        // until it reaches the end of the row, and then "snipping" it off from the end.
-        int seam_pixel_index = seam_column_indices[i];
-        while (seam_pixel_index + 1 < cumulativeEnergyMap[i].size())
-        {
-            // while-loop swaps the seam pixel until it is at the end of the row 
-            std::swap(imageMap[i][seam_pixel_index], imageMap[i][seam_pixel_index + 1]);
-            ++seam_pixel_index;
-        }
-        imageMap[i].pop_back();
-        //#ENDREGION
-        
-        //#REGION find out what the next seam pixel index is for the next iteration
-        if ((i - 1) >= 0)
-        {
-            // if-block only reached if trace-back step doesn't take us out of bounds
+void transposeMap(vector<vector<int>> &imageMap, int threads = 0);
+void displayMap(const vector<vector<int>> &map);
+void displayTranspose(const vector<vector<int>> &map);
+void validateCarveRequests(const vector<vector<int>> &imageMap, int num_vertical_seams, int num_horizontal_seams);
+double peakSignalToNoise(const vector<vector<int>> &imageMap, const vector<vector<int>> &referenceMap);
+double structuralSimilarity(const vector<vector<int>> &imageMap, const vector<vector<int>> &referenceMap);
+void writeResults(const vector<vector<int>> &imageMap, const string &filename);
+string processedFilename(const string &fullname, int num_vertical_seams, int num_horizontal_seams);
 
-            //#REGION bounds checking
-            // create a candidate list of seam pixel indices
-            // that can connect to the seam pixel in the current row.
+int main(int argc, char* argv[]) 
+{
+    std::chrono::steady_clock::time_point jobStart = std::chrono::steady_clock::now();
 
-            // declarations
-            vector<int> nextSeamPixelCandidates; 
-            int indexUpperLeft = seam_column_indices[i] - 1;
-            int indexUpper = seam_column_indices[i];
-            int indexUpperRight = seam_column_indices[i] + 1;
+    cout << " ______________________________________________________\n";
+    cout << "|                                                      |\n";
+    cout << "| 3460:435/535 Algorithms Project Three - Seam Carving |\n";
+    cout << "|______________________________________________________|\n\n";
 
-            // validate bounds of upper-left
-            bool upperLeftIsIncluded = false;
-            if ((indexUpperLeft) >= 0) 
-            { 
-                // the connecting seam pixel might be the upper-left pixel
-                nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpperLeft]);
-                upperLeftIsIncluded = true;
-            }
+    // REPLAY A CAPTURED SLOW JOB (./a --replay [capture directory])
+    if (argc == 3 && string(argv[1]) == "--replay")
+    {
+        replayCapturedJob(argv[2], argv[0]);
+    }
 
-            // no need to validate upper as it will never be out of bounds
-            nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpper]);
+    // CARVE A BATCH OF JOBS FROM SEVERAL TENANTS (./a --batch [manifest] [options])
+    if (argc >= 3 && string(argv[1]) == "--batch")
+    {
+        runBatch(argv[2], parseCarveOptions(argc, argv, 3));
+        return 0;
+    }
 
-            // validate bounds of upper-right
-            bool upperRightIsIncluded = false;
-            if ((indexUpperRight) < cumulativeEnergyMap[i].size()) 
-            { 
-                // the connecting seam pixel might be the upper-right pixel
-                nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpperRight]);
-                upperRightIsIncluded = true;
-            }
+    // CARVE EVERY CELL OF A GRID-PACKED ATLAS
+    //     ./a --atlas [pgm atlas file] [cell width] [cell height] [seams per cell | seam count file] [options]
+    if (argc >= 6 && string(argv[1]) == "--atlas")
+    {
+        runAtlas(argv[2], atoi(argv[3]), atoi(argv[4]), argv[5], parseCarveOptions(argc, argv, 6));
+        return 0;
+    }
 
-            // among the candidate seam pixels, find the one with the lowest energy
-            int seam_traceback_value = *std::min_element(nextSeamPixelCandidates.begin(), nextSeamPixelCandidates.end()); 
-            
-            // find the index in the trace-back row of this "lowest energy" pixel.
-            // we need to define a range for out search. start by assuming it includes all three candidate indices
-            int offsetStart = indexUpperLeft;
-            int offsetEnd = indexUpperRight;
-            if (!upperLeftIsIncluded)
+    // BUILD, OR READ FROM, A PACKED RETARGET STORE
+    //     ./a --store-build [store file] [image list]
+    //     ./a --store-get [store file] [image id] [width] [output pgm file]
+    if (argc == 4 && string(argv[1]) == "--store-build")
+    {
+        buildRetargetStore(argv[2], argv[3]);
+        return 0;
+    }
+    if (argc == 6 && string(argv[1]) == "--store-get")
+    {
+        RetargetStore store;
+        vector<vector<int>> result;
+        if (!store.open(argv[2]))
+        {
+            cerr << "error: '" << argv[2] << "' is not a retarget store\n";
+            exit(1);
+        }
+        if (!store.retarget(argv[3], atoi(argv[4]), result))
+        {
+            const RetargetStoreEntry *entry = store.find(argv[3]);
+            if (entry == nullptr)
             {
-                // if no upper-left, we are on a left boundary. constrain start of range
-                offsetStart = indexUpper;
+                cerr << "error: no image '" << argv[3] << "' in the store\n";
             }
-            
-            if (!upperRightIsIncluded)
+            else
             {
-                // if no upper-right, we're on a right boundary. constrain end of range
-                offsetEnd = indexUpper;
+                cerr << "error: image '" << argv[3] << "' can be produced at widths [" << entry->width - entry->maxSeams 
+                     << ", " << entry->width << "] only\n";
             }
-            //#ENDREGION
-            
-            // with the defined range to search across, look for the index of the next seam pixel
-            auto seam_traceback_itr = std::find(cumulativeEnergyMap[i - 1].begin() + offsetStart, cumulativeEnergyMap[i - 1].begin() + offsetEnd, seam_traceback_value);
-            int seam_traceback_index = std::distance(cumulativeEnergyMap[i - 1].begin(), seam_traceback_itr);
-
-            // finally, assign this index as the next iterations seam pixel index
-            seam_column_indices[i - 1] = seam_traceback_index;
-        //#ENDREGION
+            exit(1);
         }
+        writeResults(result, argv[5]);
+        cout << "Results written to '" << argv[5] << "' \n";
+        return 0;
     }
-}
 
-/// @brief Transpose a given 2D vector.
-/// @param imageMap 2D vector to transpose. Original is modified.
-void transposeMap(vector<vector<int>> &imageMap)
-{
-    // the transpose map will need as many rows as imageMap has columns
-    vector<vector<int>> transpose(imageMap[0].size(), vector<int>());
-
-    for(int i = 0; i < imageMap.size(); ++i)
+    // COMPARE THE CARVING STRATEGIES' SPEED AND QUALITY OVER A CORPUS
+    //     ./a --benchmark [corpus list] [# vertical seams] [# horizontal seams] [output csv file]
+    if (argc == 6 && string(argv[1]) == "--benchmark")
     {
-        for(int j = 0; j < imageMap[i].size(); ++j)
-        {   
-            // for each pixel in this row of imageMap,
-            // push into consecutive rows of the transpose
+        runBenchmark(argv[2], atoi(argv[3]), atoi(argv[4]), argv[5]);
+        return 0;
+    }
 
-            // Ex)   
-            // row: [1 2 3] of imageMap becomes 
-            // 
-            // column: [1]
-            //         [2]
-            //         [3]
- 
-            transpose[j].push_back(imageMap[i][j]);
+    // MAP A POINT THROUGH A COORDINATE MAP WRITTEN BY --coord-map
+    //     ./a --coord-query [coordinate map file] to-carved|to-source [x] [y]
+    if (argc == 6 && string(argv[1]) == "--coord-query")
+    {
+        CoordinateMap coordinates;
+        if (!coordinates.read(argv[2]))
+        {
+            cerr << "error: '" << argv[2] << "' is not a coordinate map\n";
+            exit(1);
+        }
+        string direction = argv[3];
+        int x = atoi(argv[4]), y = atoi(argv[5]), mappedX = 0, mappedY = 0;
+        if (direction == "to-carved" && x >= 0 && x < coordinates.sourceColumns && y >= 0 && y < coordinates.sourceRows)
+        {
+            // a carved-away point maps to the nearest surviving pixel after it
+            bool kept = coordinates.toCarved(x, y, mappedX, mappedY);
+            cout << mappedX << " " << mappedY << (kept ? "\n" : " removed\n");
+        }
+        else if (direction == "to-source" && x >= 0 && x < coordinates.carvedColumns && y >= 0 && y < coordinates.carvedRows)
+        {
+            coordinates.toSource(x, y, mappedX, mappedY);
+            cout << mappedX << " " << mappedY << "\n";
+        }
+        else
+        {
+            cerr << "error: the direction must be 'to-carved' or 'to-source', with a point inside the image\n";
+            exit(1);
         }
+        return 0;
     }
 
-    imageMap = transpose;
-
-    return;
-}
+    // VALIDATE ARGUMENTS
+    if(argc < 4) 
+    {
+        cerr << "error: invalid command-line arguments\n"
+             << "format of valid program invocation: ./a [pgm image file] [# vertical seams to remove] [# horizontal seams to remove] [options]\n";
+        exit(1);
+    }
+    CarveOptions options = parseCarveOptions(argc, argv);
 
-/// @brief Display a 2D vector.
-/// @param map The 2D vector to be displayed. 
-void displayMap(const vector<vector<int>> &map)
-{
-    for (const vector<int>& row : map)
+    // A BILEVEL PBM IMAGE IS CARVED BIT-PACKED, 64 PIXELS TO A WORD
+    if (isPbmFile(argv[1]))
     {
-        for (int pixel : row)
+        for (int k = 4; k < argc; ++k)
         {
-            if (pixel < 10)
-            {
-                cout << "  000" << pixel;
-            }
-            else if (pixel < 100)
+            if (string(argv[k]) != "--profile")
             {
-                cout << "  00" << pixel;
-            }
-            else if (pixel < 1000)
-            {
-                cout << "  0" << pixel;
-            }
-            else
-            {
-                cout << "  " << pixel;
+                cerr << "error: a pbm image is carved by the bit-packed path, which takes no options but --profile\n";
+                exit(1);
             }
         }
-        cout << "\n\n";
+
+        StageTimings bitTimings;
+        std::chrono::steady_clock::time_point bitStart = std::chrono::steady_clock::now();
+        BitImage image = loadBitImage(argv[1]);
+        bitTimings.load = secondsSince(bitStart);
+
+        int num_vertical_seams = atoi(argv[2]), num_horizontal_seams = atoi(argv[3]);
+        if (num_vertical_seams < 0 || num_horizontal_seams < 0 || num_vertical_seams >= image.columns || num_horizontal_seams >= image.rows)
+        {
+            cerr << "error: the pbm image is " << image.columns << "x" << image.rows << " pixels; request [0, " << image.columns - 1
+                 << "] vertical and [0, " << image.rows - 1 << "] horizontal seams\n";
+            exit(1);
+        }
+        carveBitImage(image, num_vertical_seams, num_horizontal_seams, bitTimings);
+
+        string fileToWrite = processedFilename(argv[1], num_vertical_seams, num_horizontal_seams);
+        fileToWrite.replace(fileToWrite.size() - 4, 4, ".pbm");
+        bitStart = std::chrono::steady_clock::now();
+        writeBitImage(image, fileToWrite);
+        bitTimings.write = secondsSince(bitStart);
+
+        cout << "\nEND PROCESSING\n";
+        cout << "Results written to '" << fileToWrite << "' \n";
+        if (options.profile)
+        {
+            displayTimings(bitTimings, secondsSince(jobStart));
+        }
+        return 0;
     }
 
-    return;
-}
+    // INITIALIZE THE IMAGE MAP 
+    string fullname = string(argv[1]);
 
-/// @brief Helper. Utilize existing functions to display the transpose of a map 
-///        without modifying the original.
-/// @param map The 2D vector whose transpose is to be displayed.
-void displayTranspose(const vector<vector<int>> &map)
-{
-    vector<vector<int>> temp(map);
+    // refuse a carve that cannot fit in the memory available to this process (or its container), from the
+    // dimensions in the header alone, before any of the image is loaded. (a header that cannot be read is left
+    // for the loader to report)
+    const ResourceLimits &limits = detectResourceLimits();
+    long long workingSet = 0;
+    int headerColumns = 0, headerRows = 0;
+    if (readPgmDimensions(fullname, headerColumns, headerRows))
+    {
+        workingSet = estimateWorkingSet(headerColumns, headerRows, options.jointFiles.size(), options);
+        if (limits.memoryBytes >= 0 && workingSet > limits.memoryBytes)
+        {
+            cerr << "error: carving this image needs about " << workingSet / (1 << 20) << " MiB, but only " 
+                 << limits.memoryBytes / (1 << 20) << " MiB of memory is available\n";
+            exit(1);
+        }
+    }
+    // derive file name to write to (./a example.pgm 10 5  --->  example_processed_10_5.pgm)
+    string fileToWrite = processedFilename(fullname, atoi(argv[2]), atoi(argv[3]));
 
-    // transposes the temporary copy and displays it
-    transposeMap(temp);
-    displayMap(temp);
+    // an identical request (same input bytes and parameters) that is already being carved is waited on, not 
+    // repeated. the key needs only the files' bytes, so it is taken before the image is loaded: a waiting 
+    // request never parses the image or runs the energy and DP passes fused into the load
+    string key;
+    if (!options.coalesceDir.empty())
+    {
+        if (options.interactive || !options.jointFiles.empty())
+        {
+            cerr << "error: --coalesce cannot be combined with --interactive or --joint\n";
+            exit(1);
+        }
+        key = coalesceKey(argc, argv, options);
+        if (!coalesceAcquire(options.coalesceDir, key, fileToWrite))
+        {
+            cout << "\nEND PROCESSING (result shared with an identical request)\n";
+            cout << "Results written to '" << fileToWrite << "' \n";
+            return 0;
+        }
+    }
 
-    return;
-}
+    TRACE_PROBE1(load__start, argv[1]);
+    StageTimings timings;
+    std::chrono::steady_clock::time_point stageStart = std::chrono::steady_clock::now();
+    // a plain carve starting with a vertical seam has its first energy and DP passes fused into the load
+    bool fusedLoad = options.energyFile.empty() && options.jointFiles.empty() && !options.bidirectional 
+                  && !options.interactive && atoi(argv[2]) > 0;
+    vector<vector<int>> E, loadedCE;
+    vector<vector<int>> I = fusedLoad ? initImageMapFused(fullname, E, loadedCE) : initImageMap(fullname);
+    timings.load += secondsSince(stageStart);
+    TRACE_PROBE2(load__end, (int)I[0].size(), (int)I.size());
 
-/// @brief Validate command-line args for the number of seams to remove are within the acceptable range.
-/// @param imageMap The image map for which the seam carving requests are to be completed on.
-/// @param num_vertical_seams Number of vertical seams to remove. If outside range [0, imageMap(num_columns) - 1], the request is invalid.
-/// @param num_horizontal_seams Number of horizontal seams to remove. If outside range [0, imageMap(num_rows) - 1], the request is invalid.
-void validateCarveRequests(const vector<vector<int>> &imageMap, int num_vertical_seams, int num_horizontal_seams)
-{
-    // validate vertical seam request
-    if (num_vertical_seams < 0)
+    // validate command-line args for vertical/horizontal carve requests
+    int num_vertical_seams = atoi(argv[2]);
+    int num_horizontal_seams = atoi(argv[3]);
+    validateCarveRequests(I, num_vertical_seams, num_horizontal_seams);
+
+    // aligned images to be carved with the same seams as I
+    vector<vector<vector<int>>> J;
+    stageStart = std::chrono::steady_clock::now();
+    for (const string &jointFile : options.jointFiles)
     {
-        cerr << "error: requested number of vertical seams to carve must be greater than or equal to 0\n";
+        J.push_back(initImageMap(jointFile));
+        if (J.back().size() != I.size() || J.back()[0].size() != I[0].size())
+        {
+            cerr << "error: '" << jointFile << "' is " << J.back()[0].size() << "x" << J.back().size() 
+                 << " but '" << fullname << "' is " << I[0].size() << "x" << I.size() << "; jointly carved images must match\n";
+            exit(1);
+        }
+    }
+    timings.load += secondsSince(stageStart);
+
+    if (!J.empty() && (options.interactive || !options.energyFile.empty()))
+    {
+        cerr << "error: --joint cannot be combined with --interactive or --energy\n";
         exit(1);
     }
-    if (num_vertical_seams >= imageMap[0].size())
+    if (!options.seamIndexDir.empty() && (options.interactive || !options.energyFile.empty() || !J.empty()))
     {
-        cerr << "error: the requested number of vertical seams to carve is " << num_vertical_seams << ", which is invalid.\n"
-             << "the provided image is " << imageMap[0].size() << " pixels wide. to carve the requested number of vertical seams would be to\n"
-             << "erase the image entirely\n";
+        cerr << "error: --seam-index cannot be combined with --interactive, --energy or --joint\n";
         exit(1);
     }
-
-    // validate horizontal seam request
-    if (num_horizontal_seams < 0)
+    if (!options.coordMapFile.empty() && (options.interactive || !options.coalesceDir.empty()))
     {
-        cerr << "error: requested number of horizontal seams to carve must be greater than or equal to 0\n";
+        cerr << "error: --coord-map cannot be combined with --interactive or --coalesce\n";
         exit(1);
     }
-    if (num_horizontal_seams >= imageMap.size())
+    if (options.lazyEnergy > 0 && (options.interactive || !options.energyFile.empty() || !J.empty()))
     {
-        cerr << "error: the requested number of horizontal seams to carve is " << num_horizontal_seams << ", which is invalid.\n"
-             << "the provided image is " << imageMap.size() << " pixels tall. to carve the requested number of horizontal seams would be to\n"
-             << "erase the image entirely\n";
+        cerr << "error: --lazy-energy cannot be combined with --interactive, --energy or --joint\n";
+        exit(1);
+    }
+    if (options.incrementalDP && (options.bidirectional || options.lazyEnergy > 0 || options.interactive || !options.energyFile.empty() || !J.empty()))
+    {
+        cerr << "error: --incremental-dp cannot be combined with --bidirectional, --lazy-energy, --interactive, --energy or --joint\n";
         exit(1);
     }
 
-    return;
-}
+    if (options.interactive)
+    {
+        // INTERACTIVE SESSION (vertical seams only; width is adjusted by commands on stdin)
+        if (num_horizontal_seams != 0)
+        {
+            cerr << "error: an interactive session adjusts width only; request 0 horizontal seams\n";
+            exit(1);
+        }
+        vector<vector<int>> E = options.energyFile.empty() ? initEnergyMap(I) : loadEnergyMap(options.energyFile, options.energyScale, I);
+        runInteractiveSession(I, E, num_vertical_seams, options);
+        return 0;
+    }
 
-/// @brief  Write the seam-carved image map to a file. 
-/// @param imageMap The image map that has been modified by the seam carving algorithm.
-/// @param filename Name of the file to write the results to.
-void writeResults(const vector<vector<int>> &imageMap, const string &filename)
-{
-    ofstream outFile(filename);
+    // cout << "'" << argv[1] << "' --> Initial Image Map:\n";
+    // displayMap(I);
 
-    outFile << "P2\n"; // for pgm file type
-    outFile << "# Processed by Seam Carving Inc.\n"; // Seam Carving Incorporated!!!
-    outFile << imageMap[0].size() << " " << imageMap.size() << "\n";  // first the # columns, then # rows, to match pgm file format for irfanview
+    // an externally supplied energy map is carved along with the image instead of being recomputed
+    if (!options.energyFile.empty())
+    {
+        stageStart = std::chrono::steady_clock::now();
+        E = loadEnergyMap(options.energyFile, options.energyScale, I);
+        timings.load += secondsSince(stageStart);
+    }
 
-    // we need to iterate through the imageMap and find the maximum value
-    int max_val = imageMap[0][0];
-    for (const auto& row : imageMap) 
+    // a near-duplicate of an image carved before can reuse its seams, once they are verified against this image
+    bool reused = false;
+    unsigned long long hash = 0;
+    int original_columns = I[0].size(), original_rows = I.size();
+    CarveReport report;
+    report.logSeams = !options.seamIndexDir.empty();
+    CoordinateMap coordinates(original_columns, original_rows);
+    // a lazy carve being profiled is compared against an exact carve of the same image afterwards
+    bool compareLazy = options.lazyEnergy > 1 && options.profile;
+    vector<vector<int>> original = compareLazy ? I : vector<vector<int>>();
+    report.logSeams = report.logSeams || compareLazy;
+    if (!options.coordMapFile.empty())
     {
-        for (auto val : row) 
+        report.coordinates = &coordinates;
+    }
+    if (!options.seamIndexDir.empty())
+    {
+        hash = perceptualHash(I);
+
+        vector<SeamRecord> storedSeams;
+        if (findNearDuplicate(options.seamIndexDir, hash, I, num_vertical_seams, num_horizontal_seams, options.seamIndexDistance, storedSeams))
         {
-            if (val > max_val) 
+            vector<vector<int>> candidate(I);
+            if (replaySeams(candidate, storedSeams, options.seamIndexTolerance))
             {
-                max_val = val;
+                cout << "\nnear-duplicate found in the seam index; its seams were verified and reused\n";
+                I = candidate;
+                reused = true;
+                for (const SeamRecord &seam : storedSeams)
+                {
+                    coordinates.removeSeam(seam.horizontal, seam.columns);
+                }
+            }
+            else
+            {
+                cout << "\nnear-duplicate found in the seam index, but its seams failed verification; carving in full\n";
             }
         }
     }
-    outFile << max_val << "\n";
 
-    // write processed image map
+    if (!reused)
+    {
+        carveSeams(I, J, E, num_vertical_seams, num_horizontal_seams, options, report, fusedLoad ? &loadedCE : nullptr);
+    }
+
+    // WRITE RESULTS TO FILE
+
+    // write the processed image to fileToWrite
+    TRACE_PROBE(write__start);
+    stageStart = std::chrono::steady_clock::now();
+    writeResults(I, fileToWrite);
+    report.timings.write += secondsSince(stageStart);
+    TRACE_PROBE(write__end);
+    if (!options.coalesceDir.empty())
+    {
+        // hand the result to any identical requests waiting on it
+        coalescePublish(options.coalesceDir, key, fileToWrite);
+    }
+
+    if (!options.coordMapFile.empty())
+    {
+        coordinates.write(options.coordMapFile);
+    }
+
+    // and each jointly carved image alongside its own source
+    for (int k = 0; k < J.size(); ++k)
+    {
+        writeResults(J[k], processedFilename(options.jointFiles[k], num_vertical_seams, num_horizontal_seams));
+    }
+
+    cout << "\nEND PROCESSING\n";
+    cout << "Results written to '" << fileToWrite << "' \n";
+
+    // PROFILE, TELEMETRY AND CAPTURE
+    report.timings.load = timings.load;
+    if (!options.telemetryFile.empty())
+    {
+        writeTelemetry(options.telemetryFile);
+    }
+    double seconds = secondsSince(jobStart);
+    if (options.profile)
+    {
+        displayTimings(report.timings, seconds);
+        cout << "resources: " << limits.cpus << " cpu(s), ";
+        if (limits.memoryBytes < 0)
+        {
+            cout << "no memory limit";
+        }
+        else
+        {
+            cout << limits.memoryBytes / (1 << 20) << " MiB memory limit";
+        }
+        cout << ", ~" << workingSet / (1 << 20) << " MiB working set\n";
+    }
+    if (compareLazy && !reused)
+    {
+        // the lazy seams' cost is measured on the exact energy, as the exact carve's is
+        CarveOptions exactOptions = options;
+        exactOptions.lazyEnergy = 0;
+        exactOptions.telemetryFile.clear();
+        CarveReport exactReport;
+        exactReport.logSeams = true;
+        vector<vector<int>> exact = original, exactE;
+        vector<vector<vector<int>>> noJoint;
+        carveSeams(exact, noJoint, exactE, num_vertical_seams, num_horizontal_seams, exactOptions, exactReport);
+
+        long long lazyCost = exactSeamsEnergy(original, report.seams), exactCost = 0;
+        for (const SeamRecord &seam : exactReport.seams)
+        {
+            exactCost += seam.energy;
+        }
+        cout << "\nlazy energy: " << report.energyRecomputes << " full energy map(s) for " << report.seams.size()
+             << " seams, against " << exactReport.energyRecomputes << " exact\n"
+             << "total seam energy " << lazyCost << " against " << exactCost << " exact (" << std::showpos << std::fixed
+             << std::setprecision(2) << (exactCost > 0 ? 100.0 * (lazyCost - exactCost) / exactCost : 0.0) << "%"
+             << std::noshowpos << "), PSNR against the exact result " << peakSignalToNoise(I, exact) << " dB\n";
+        cout.unsetf(std::ios::floatfield);
+        cout << std::setprecision(6);
+    }
+    if (!options.captureDir.empty())
+    {
+        // a job slower than its predicted cost by the capture factor is recorded for offline reproduction
+        double predictedSeconds = predictedCells(original_columns, original_rows, num_vertical_seams, num_horizontal_seams) 
+                                * (1 + J.size()) * options.captureNsPerCell * 1e-9;
+        if (seconds > options.captureFactor * predictedSeconds)
+        {
+            captureSlowJob(options.captureDir, argc, argv, report.timings, seconds, predictedSeconds);
+        }
+    }
+
+    // only now, so that a capture holds the seam index as this job found it, without its own seams
+    if (!options.seamIndexDir.empty() && !reused)
+    {
+        // remember this image's seams for its near-duplicates
+        addToSeamIndex(options.seamIndexDir, hash, original_columns, original_rows, num_vertical_seams, num_horizontal_seams, report.seams);
+    }
+    
+    return 0;
+}
+
+/// @brief Carve the requested number of vertical, then horizontal, seams out of an image.
+/// @param I The image map. Modified.
+/// @param J Images carved jointly with I (same seams, energy summed over all). Modified. May be empty.
+/// @param E The energy map. If options.energyFile is set this is the precomputed map, carved along with I;
+///          otherwise it is recomputed from I for every seam (or, with options.lazyEnergy, every so many seams
+///          and carved along with I in between, or with options.incrementalDP, only for the first seam in each
+///          direction and then carved along with I and refreshed next to each seam).
+/// @param num_vertical_seams Number of vertical seams to carve.
+/// @param num_horizontal_seams Number of horizontal seams to carve.
+/// @param options The carving options.
+/// @param report Receives the time spent in each stage and, if report.logSeams is set, every seam carved.
+/// @param loadedCE If not null, the cumulative energy map of I computed by initImageMapFused, with E its energy 
+///                 map; the first vertical seam is then found from them directly.
+void carveSeams(vector<vector<int>> &I, vector<vector<vector<int>>> &J, vector<vector<int>> &E, 
+                int num_vertical_seams, int num_horizontal_seams, const CarveOptions &options, CarveReport &report, 
+                const vector<vector<int>> *loadedCE)
+{
+    std::chrono::steady_clock::time_point stageStart;
+
+    // a lazily refreshed energy map goes stale between full recomputes: it is carved along with the image,
+    // with no fix-ups next to the seams, until options.lazyEnergy seams have been carved or the cost drifts
+    bool lazy = options.lazyEnergy > 1 && J.empty() && options.energyFile.empty();
+    int seamsSinceRecompute = 0;
+    long long recomputeCost = 0; // cost of the first seam after the last recompute
+    bool drifted = false;
+
+    // an incremental carve keeps E exact by refreshing it next to each seam, and keeps the cumulative energy
+    // map CE exact by carving it too and repairing only the cells the seam can have changed
+    bool incremental = options.incrementalDP && J.empty() && options.energyFile.empty() && !lazy;
+    vector<vector<int>> CE;
+    vector<int> carvedSeam; // the seam CE was last carved by, still to be repaired
+
+    // CARVE THE REQUESTED NUMBER OF VERTICAL SEAMS
+    vector<int> previousSeam; // for telemetry
+    for (int i = 1; i <= num_vertical_seams; ++i)
+    {
+        cout << "\n[C][A][R][V][I][N][G] [V[E][R][T][I][C][A][L] [S][E][A][M] [" << i << "]\n";
+        TRACE_PROBE3(seam__start, 0, i, (int)I[0].size());
+
+        // cout << "\nInitial Image Map:\n";
+        // displayMap(I);
+
+        // INITIALIZE THE ENERGY MAP (summed over all jointly carved images), unless it was computed while loading
+        bool preloaded = i == 1 && loadedCE != nullptr;
+        bool stale = lazy && i > 1 && seamsSinceRecompute < options.lazyEnergy && !drifted;
+        bool repaired = incremental && i > 1;
+        TRACE_PROBE(energy__start);
+        stageStart = std::chrono::steady_clock::now();
+        if (preloaded)
+        {
+            // E already holds the energy map computed by initImageMapFused
+        }
+        else if (stale)
+        {
+            // E was carved along with I since the last recompute
+        }
+        else if (repaired)
+        {
+            // E was carved along with I and refreshed next to the last seam
+        }
+        else if (!J.empty())
+        {
+            E = initJointEnergyMap(I, J);
+        }
+        else if (options.energyFile.empty())
+        {
+            E = initEnergyMap(I);
+        }
+        report.timings.energy += secondsSince(stageStart);
+        long long energyCells = options.energyFile.empty() && !stale && !repaired ? (long long)I.size() * I[0].size() : 0;
+        if (energyCells > 0)
+        {
+            ++report.energyRecomputes;
+            seamsSinceRecompute = 0;
+        }
+        TRACE_PROBE(energy__end);
+        
+        // cout << "\nEnergy Map: \n";
+        // displayMap(E);
+
+        // FIND THE LOWEST ENERGY SEAM
+        TRACE_PROBE(dp__start);
+        stageStart = std::chrono::steady_clock::now();
+        long long dpCells = (long long)I.size() * I[0].size(), prunedCells = 0;
+        vector<int> seam;
+        if (repaired)
+        {
+            long long repairedCells = repairCumulativeEnergyMap(E, CE, carvedSeam);
+            prunedCells = dpCells - repairedCells;
+            dpCells = repairedCells;
+            seam = findSeam(CE);
+        }
+        else if (incremental)
+        {
+            CE = preloaded ? *loadedCE : initCumulativeEnergyMap(E);
+            seam = findSeam(CE);
+        }
+        else
+        {
+            seam = preloaded ? findSeam(*loadedCE) : findLowestEnergySeam(E, options);
+        }
+        report.timings.dp += secondsSince(stageStart);
+        TRACE_PROBE(dp__end);
+        long long energy = report.logSeams || !options.telemetryFile.empty() || lazy ? seamEnergy(E, seam) : 0;
+        if (report.logSeams)
+        {
+            report.seams.push_back(SeamRecord{ false, energy, seam });
+        }
+        if (lazy)
+        {
+            recomputeCost = seamsSinceRecompute++ == 0 ? energy : recomputeCost;
+            drifted = options.lazyDrift > 0 && std::abs(energy - recomputeCost) > options.lazyDrift * recomputeCost;
+        }
+
+        // CARVE OUT THE SEAM (from every jointly carved image too)
+        TRACE_PROBE(remove__start);
+        stageStart = std::chrono::steady_clock::now();
+        removeSeamJoint(I, J, seam);
+        if (report.coordinates != nullptr)
+        {
+            report.coordinates->removeSeam(false, seam);
+        }
+        if (!options.energyFile.empty())
+        {
+            removeSeam(E, seam);
+            energyCells += refreshEnergyNearSeam(I, E, seam, options.energyUpdate);
+        }
+        else if (lazy)
+        {
+            removeSeam(E, seam);
+        }
+        else if (incremental)
+        {
+            removeSeam(E, seam);
+            energyCells += refreshEnergyNearSeam(I, E, seam);
+            removeSeam(CE, seam);
+            carvedSeam = seam;
+        }
+        report.timings.remove += secondsSince(stageStart);
+        if (!options.telemetryFile.empty())
+        {
+            recordSeamTelemetry(false, i, energy, seam, previousSeam, energyCells, dpCells, prunedCells);
+            previousSeam = seam;
+        }
+        TRACE_PROBE(remove__end);
+        TRACE_PROBE2(seam__end, 0, i);
+
+        // cout << "\nSeam-Carved Image Map: \n";
+        // displayMap(I);
+    }
+
+    // CARVE THE REQUESTED NUMBER OF HORIZONATL SEAMS
+    if (num_horizontal_seams > 0)
+    {    
+        // if-block protects against unecessarily transposing the image map
+
+        transposeMap(I); // transpose the map to reuse the vertical seam carver for horizontal seams
+        for (vector<vector<int>> &jointMap : J)
+        {
+            transposeMap(jointMap);
+        }
+        if (!options.energyFile.empty())
+        {
+            transposeMap(E);
+        }
+        previousSeam.clear();
+        for (int i = 1; i <= num_horizontal_seams; ++i)
+        {
+            cout << "\n[C][A][R][V][I][N][G] [H[O][R][I][Z][O][N][T][A][L] [S][E][A][M] [" << i << "]\n";
+            TRACE_PROBE3(seam__start, 1, i, (int)I[0].size());
+
+            // cout << "\nInitial Image Map:\n";
+            // displayTranspose(I);
+
+            // INITIALIZE THE ENERGY MAP (summed over all jointly carved images)
+            bool stale = lazy && i > 1 && seamsSinceRecompute < options.lazyEnergy && !drifted;
+            bool repaired = incremental && i > 1;
+            TRACE_PROBE(energy__start);
+            stageStart = std::chrono::steady_clock::now();
+            if (stale)
+            {
+                // E was carved along with I since the last recompute
+            }
+            else if (repaired)
+            {
+                // E was carved along with I and refreshed next to the last seam
+            }
+            else if (!J.empty())
+            {
+                E = initJointEnergyMap(I, J);
+            }
+            else if (options.energyFile.empty())
+            {
+                E = initEnergyMap(I);
+            }
+            report.timings.energy += secondsSince(stageStart);
+            long long energyCells = options.energyFile.empty() && !stale && !repaired ? (long long)I.size() * I[0].size() : 0;
+            if (energyCells > 0)
+            {
+                ++report.energyRecomputes;
+                seamsSinceRecompute = 0;
+            }
+            TRACE_PROBE(energy__end);
+            
+            // cout << "\nEnergy Map: \n";
+            // displayTranspose(E);
+
+            // FIND THE LOWEST ENERGY SEAM
+            TRACE_PROBE(dp__start);
+            stageStart = std::chrono::steady_clock::now();
+            long long dpCells = (long long)I.size() * I[0].size(), prunedCells = 0;
+            vector<int> seam;
+            if (repaired)
+            {
+                long long repairedCells = repairCumulativeEnergyMap(E, CE, carvedSeam);
+                prunedCells = dpCells - repairedCells;
+                dpCells = repairedCells;
+                seam = findSeam(CE);
+            }
+            else if (incremental)
+            {
+                CE = initCumulativeEnergyMap(E);
+                seam = findSeam(CE);
+            }
+            else
+            {
+                seam = findLowestEnergySeam(E, options);
+            }
+            report.timings.dp += secondsSince(stageStart);
+            TRACE_PROBE(dp__end);
+            long long energy = report.logSeams || !options.telemetryFile.empty() || lazy ? seamEnergy(E, seam) : 0;
+            if (report.logSeams)
+            {
+                report.seams.push_back(SeamRecord{ true, energy, seam });
+            }
+            if (lazy)
+            {
+                recomputeCost = seamsSinceRecompute++ == 0 ? energy : recomputeCost;
+                drifted = options.lazyDrift > 0 && std::abs(energy - recomputeCost) > options.lazyDrift * recomputeCost;
+            }
+
+            // CARVE OUT THE SEAM (from every jointly carved image too)
+            TRACE_PROBE(remove__start);
+            stageStart = std::chrono::steady_clock::now();
+            removeSeamJoint(I, J, seam);
+            if (report.coordinates != nullptr)
+            {
+                report.coordinates->removeSeam(true, seam);
+            }
+            if (!options.energyFile.empty())
+            {
+                removeSeam(E, seam);
+                energyCells += refreshEnergyNearSeam(I, E, seam, options.energyUpdate);
+            }
+            else if (lazy)
+            {
+                removeSeam(E, seam);
+            }
+            else if (incremental)
+            {
+                removeSeam(E, seam);
+                energyCells += refreshEnergyNearSeam(I, E, seam);
+                removeSeam(CE, seam);
+                carvedSeam = seam;
+            }
+            report.timings.remove += secondsSince(stageStart);
+            if (!options.telemetryFile.empty())
+            {
+                recordSeamTelemetry(true, i, energy, seam, previousSeam, energyCells, dpCells, prunedCells);
+                previousSeam = seam;
+            }
+            TRACE_PROBE(remove__end);
+            TRACE_PROBE2(seam__end, 1, i);
+
+            // cout << "\nSeam-Carved Image Map: \n";
+            // displayTranspose(I);
+        }
+        transposeMap(I); // undo the transpose
+        for (vector<vector<int>> &jointMap : J)
+        {
+            transposeMap(jointMap);
+        }
+    }
+}
+
+/// @brief A 2D vector of integers is populated with the image pixel values comprising the pgm image file, 'filename'.
+/// @param filename Name of a file with a pgm extension.
+/// @return The resultant image map by value.
+/// @note initImageMap assumes the pgm file format outlined in the project description is rigorously adhered to. 
+///       Noteably, a hard assumption is made that one optional comment is in the file, necessarily on line two (if it exists).
+vector<vector<int>> initImageMap(const string &filename)
+{
+    vector<vector<int>> result;
+    string problem;
+    if (!loadImageMap(filename, result, problem))
+    {
+        cerr << "error: " << problem;
+        exit(1);
+    }
+
+    return result;
+}
+
+/// @brief initImageMap without the exit: a malformed file is reported to the caller, so one bad image in a
+///        batch fails only its own job instead of the whole process.
+/// @param filename Name of a file with a pgm extension.
+/// @param imageMap Receives the image map.
+/// @param problem Receives what is wrong with the file, if it cannot be loaded.
+/// @return True if the image was loaded.
+bool loadImageMap(const string &filename, vector<vector<int>> &imageMap, string &problem)
+{
+    ifstream pgmInputFile(filename);
+    int columns = 0, rows = 0, maxPixelValue = 0;
+    if (!parsePgmHeader(pgmInputFile, filename, columns, rows, maxPixelValue, problem))
+    {
+        return false;
+    }
+
+    // #REGION parse_data
+    // read raw pixel data into a string, and subsequently into a stringstream
+    string temp_line;
+    string pixelData;
+    stringstream ssPixelData;
+    while (!pgmInputFile.eof())
+    {
+        // grab a row of data
+        getline(pgmInputFile, temp_line); 
+
+        // if temp_line does not end in a whitespace we will append one ourself 
+        if (temp_line.empty() || temp_line[temp_line.size() - 1] != ' ')
+        {
+            temp_line.append(" ");
+        }
+
+        // append to the result string
+        pixelData += temp_line;
+    }
+    ssPixelData << pixelData;
+
+    // populate a 2D vector with the data
+    vector<vector<int>> &result = imageMap;
+    result.clear();
+    int pixel = 0;
+    for (int i = 0; i < rows; ++i)
+    {
+        // outer-for iterates over rows
+
+        vector<int> rowResult;
+        for (int j = 0; j < columns; ++j)
+        {
+            // inner-for iterates over individual pixels in each row
+            if (!(ssPixelData >> pixel))
+            {
+                problem = "the pixel data of '" + filename + "' ends before its " + std::to_string(columns) + "x" + std::to_string(rows) + " pixels\n";
+                return false;
+            }
+
+            // ensure the pixel is within the valid range of values
+            if (pixel > maxPixelValue || pixel < 0)
+            {
+                problem = "a pixel value exists in the image data which falls outside the given acceptable range of [0, " + std::to_string(maxPixelValue) + "]\n";
+                return false;
+            }
+            
+            rowResult.push_back(pixel);
+        }
+        
+        result.push_back(rowResult);
+    }
+    // #ENDREGION
+
+    return true;
+}
+
+/// @brief Read the header of a pgm file (see initImageMap for the format), leaving the stream at the pixel data.
+/// @param pgmInputFile The open pgm file.
+/// @param filename Its name, for error messages.
+/// @param columns Receives the column count.
+/// @param rows Receives the row count.
+/// @param maxPixelValue Receives the maximum greyscale value.
+void readPgmHeader(ifstream &pgmInputFile, const string &filename, int &columns, int &rows, int &maxPixelValue)
+{
+    string problem;
+    if (!parsePgmHeader(pgmInputFile, filename, columns, rows, maxPixelValue, problem))
+    {
+        cerr << "error: " << problem;
+        exit(1);
+    }
+}
+
+/// @brief readPgmHeader without the exit (see loadImageMap).
+/// @param problem Receives what is wrong with the header, if it is malformed.
+/// @return True if the header was read.
+bool parsePgmHeader(ifstream &pgmInputFile, const string &filename, int &columns, int &rows, int &maxPixelValue, string &problem)
+{
+    // validate good connection to the input file
+    if (!pgmInputFile) 
+    {
+        problem = "could not open file '" + filename + "'\n"
+                  "check the file name is correct and the file is located at the same directory level as the executable\n";
+        return false;
+    }
+
+    // #REGION parse_to_data 
+    string temp_line;
+    
+    // handle file format line
+    getline(pgmInputFile, temp_line); // "P2"
+    if (temp_line != "P2") 
+    { 
+        // this program handles only P2 images, meaning colors must be in greyscale
+        problem = "invalid pgm file format\n"
+                  "file format was read as '" + temp_line + "', while the supported format is 'P2' for a PGM file\n";
+        return false;
+    }
+
+    // @NOTE - crucially, the code here assumes line two of the header is the singular comment-line, or there are no comments in the file at all
+    if (pgmInputFile.peek() == '#') 
+    { 
+        getline(pgmInputFile, temp_line); // skip optional comment
+    }
+
+    getline(pgmInputFile, temp_line); // columns X rows
+
+    // parse out the column and row count from this line
+    columns = 0, rows = 0;
+    stringstream dimensions;      
+    dimensions << temp_line;       // read entire line into string stream
+    dimensions >> columns >> rows; // write whitespace seperated values into variables
+
+    // something went wrong if these are still 0
+    if (columns == 0 || rows == 0)
+    {
+        // an error occured in reading the image dimensions
+        problem = "a problem occured in reading the pgm file dimensions\n"
+                  "please ensure the data format outlined in the project description is strictly adhered to \n";
+        return false;
+    }
+
+    getline(pgmInputFile, temp_line); // maximum greyscale value
+    maxPixelValue = 0;
+    stringstream(temp_line) >> maxPixelValue;
+    if (maxPixelValue <= 0)
+    {
+        problem = "the maximum greyscale value of '" + filename + "' is missing or not positive\n";
+        return false;
+    }
+    // #ENDREGION
+
+    return true;
+}
+
+/// @brief Load a pgm image fused with its first energy and cumulative energy passes. As each row of pixels is 
+///        parsed, the energy of the row above it (whose neighbors are now all known) is computed, and then that 
+///        row's cumulative energy, each while the rows it draws on are still in cache. The pixel range check is 
+///        made as each value is parsed. The result matches initImageMap, initEnergyMap and initCumulativeEnergyMap.
+/// @param filename Name of a file with a pgm extension.
+/// @param energyMap Receives the image's energy map.
+/// @param cumulativeEnergyMap Receives the image's cumulative energy map, ready for the first seam.
+/// @return The resultant image map by value.
+vector<vector<int>> initImageMapFused(const string &filename, vector<vector<int>> &energyMap, vector<vector<int>> &cumulativeEnergyMap)
+{
+    ifstream pgmInputFile(filename, std::ios::binary);
+    int columns = 0, rows = 0, maxPixelValue = 0;
+    readPgmHeader(pgmInputFile, filename, columns, rows, maxPixelValue);
+
+    // the pixel data is read in one go, then scanned in place
+    string pixelData((std::istreambuf_iterator<char>(pgmInputFile)), std::istreambuf_iterator<char>());
+    const char *cursor = pixelData.c_str();
+
+    vector<vector<int>> result(rows, vector<int>(columns));
+    energyMap.assign(rows, vector<int>(columns));
+    cumulativeEnergyMap.assign(rows, vector<int>(columns));
+
+    // computes energy row i, then cumulative energy row i; rows i - 1 and i + 1 (if any) must be parsed
+    auto finishRow = [&](int i)
+    {
+        const vector<vector<int>> &image = result;
+        for (int j = 0; j < columns; ++j)
+        {
+            energyMap[i][j] = pixelEnergy(image, i, j);
+        }
+
+        if (i == 0)
+        {
+            cumulativeEnergyMap[0] = energyMap[0];
+            return;
+        }
+        const vector<int> &above = cumulativeEnergyMap[i - 1];
+        for (int j = 0; j < columns; ++j)
+        {
+            int best = above[j];
+            if (j - 1 >= 0)
+            {
+                best = std::min(best, above[j - 1]);
+            }
+            if (j + 1 < columns)
+            {
+                best = std::min(best, above[j + 1]);
+            }
+            cumulativeEnergyMap[i][j] = energyMap[i][j] + best;
+        }
+    };
+
+    for (int i = 0; i < rows; ++i)
+    {
+        // #REGION parse a row
+        for (int j = 0; j < columns; ++j)
+        {
+            while (*cursor == ' ' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t')
+            {
+                ++cursor;
+            }
+
+            bool negative = *cursor == '-';
+            cursor += negative;
+            if (*cursor < '0' || *cursor > '9')
+            {
+                cerr << "error: the pgm file '" << filename << "' has fewer pixels (or other characters) where " 
+                     << columns << "x" << rows << " pixel values were expected\n";
+                exit(1);
+            }
+
+            long long pixel = 0;
+            while (*cursor >= '0' && *cursor <= '9')
+            {
+                pixel = std::min(pixel * 10 + (*cursor++ - '0'), (long long)maxPixelValue + 1);
+            }
+
+            // ensure the pixel is within the valid range of values
+            if (negative || pixel > maxPixelValue)
+            {
+                cerr << "error: a pixel value exists in the image data which falls outside the given acceptable range of [0, " << maxPixelValue << "]\n";
+                exit(1);
+            }
+
+            result[i][j] = pixel;
+        }
+        // #ENDREGION
+
+        // the row above now has all its neighbors
+        if (i >= 1)
+        {
+            finishRow(i - 1);
+        }
+    }
+    finishRow(rows - 1);
+
+    return result;
+}
+
+/// @brief A 2D vector of integers is populated with pixel energy values using an image map produced by initImageMap.
+/// @param imageMap A 2D vector containing the pixel data of a pgm file
+/// @return The resultant energy map by value.
+vector<vector<int>> initEnergyMap(const vector<vector<int>> &imageMap)
+{
+    TRACE_PROBE1(workspace__alloc, (long)(imageMap.size() * imageMap[0].size() * sizeof(int)));
+    vector<vector<int>> result;
+    for (int i = 0; i < imageMap.size(); ++i)
+    {
+        // outer-for iterates over rows
+
+        vector<int> rowResult;
+        for (int j = 0; j < imageMap[i].size(); ++j) 
+        {
+            // inner-for iterates over individual pixels in each row
+            
+            // store the energy of the pixel
+            rowResult.push_back(pixelEnergy(imageMap, i, j));
+        }
+
+        result.push_back(rowResult);
+    }
+    
+    return result;
+}
+
+/// @brief The energy of a single pixel: the sum of its absolute differences to its neighbors along X and Y.
+/// @param imageMap A 2D vector containing the pixel data of a pgm file
+/// @param i Row of the pixel.
+/// @param j Column of the pixel.
+/// @return The energy of pixel (i, j). Neighbors falling outside the image count as the pixel itself.
+int pixelEnergy(const vector<vector<int>> &imageMap, int i, int j)
+{
+    // #REGION find ΔI along X axis 
+    // bounds checking X
+    int left = (j - 1) >= 0 ? imageMap[i][j - 1] : imageMap[i][j]; 
+    int right = (j + 1) < imageMap[i].size() ? imageMap[i][j + 1] : imageMap[i][j];
+
+    int changeX = abs(imageMap[i][j] - left) + abs(imageMap[i][j] - right);
+    // #ENDREGION
+
+    // #REGION find ΔI along Y axis 
+    // bounds checking Y
+    int up = (i - 1) >= 0 ? imageMap[i - 1][j] : imageMap[i][j];
+    int down = (i + 1) < imageMap.size() ? imageMap[i + 1][j] : imageMap[i][j];
+
+    int changeY = abs(imageMap[i][j] - up) + abs(imageMap[i][j] - down);
+    // #ENDREGION
+
+    return changeX + changeY;
+}
+
+/// @brief A 2D vector of integers is populated with the energy of each pixel summed over several aligned images,
+///        so that a seam found in it is the lowest energy seam across all of them at once.
+/// @param imageMap The first image.
+/// @param jointMaps The other images, each the same size as imageMap.
+/// @return The resultant energy map by value.
+/// @note The images are accumulated row by row in a single pass, so each output row is built while it, 
+///       and the three input rows it draws on from each image, are still in cache. Interior pixels take a 
+///       branch-free path the compiler can vectorize; only the first and last columns are bounds checked.
+vector<vector<int>> initJointEnergyMap(const vector<vector<int>> &imageMap, const vector<vector<vector<int>>> &jointMaps)
+{
+    int num_rows = imageMap.size();
+    int num_columns = imageMap[0].size();
+
+    vector<const vector<vector<int>> *> images(1, &imageMap);
+    for (const vector<vector<int>> &jointMap : jointMaps)
+    {
+        images.push_back(&jointMap);
+    }
+
+    vector<vector<int>> result(num_rows, vector<int>(num_columns, 0));
+    for (int i = 0; i < num_rows; ++i)
+    {
+        int *out = result[i].data();
+
+        for (const vector<vector<int>> *image : images)
+        {
+            // out-of-bounds vertical neighbors count as the pixel itself, as in pixelEnergy
+            const int *row = (*image)[i].data();
+            const int *up = (*image)[i - 1 >= 0 ? i - 1 : i].data();
+            const int *down = (*image)[i + 1 < num_rows ? i + 1 : i].data();
+
+            for (int j = 1; j + 1 < num_columns; ++j)
+            {
+                out[j] += abs(row[j] - row[j - 1]) + abs(row[j] - row[j + 1]) 
+                        + abs(row[j] - up[j]) + abs(row[j] - down[j]);
+            }
+
+            // the first and last columns have no left (or right) neighbor
+            out[0] += (num_columns > 1 ? abs(row[0] - row[1]) : 0) + abs(row[0] - up[0]) + abs(row[0] - down[0]);
+            if (num_columns > 1)
+            {
+                int last = num_columns - 1;
+                out[last] += abs(row[last] - row[last - 1]) + abs(row[last] - up[last]) + abs(row[last] - down[last]);
+            }
+        }
+    }
+
+    return result;
+}
+
+/// @brief After a seam has been removed from (or inserted into) both the image map and its energy map, 
+///        recompute the energy of only those pixels whose neighbors changed, rather than the whole map.
+/// @param imageMap The image map, already carved (or grown).
+/// @param energyMap The energy map, already carved (or grown) in lockstep with the image map. Modified in place.
+/// @param seam One column index per row, marking where the seam was removed (or inserted).
+/// @param update How the pixels next to the seam are updated: recomputed, left frozen, or blended 
+///               (averaged with their recomputed value), the latter two being for precomputed energy maps.
+/// @return The number of energy cells recomputed.
+/// @note A pixel's neighbors can only change within one column of the seam in its own row or 
+///       the rows directly above and below, so the work done is O(rows).
+int refreshEnergyNearSeam(const vector<vector<int>> &imageMap, vector<vector<int>> &energyMap, const vector<int> &seam, EnergyUpdate update)
+{
+    if (update == ENERGY_FREEZE)
+    {
+        return 0;
+    }
+
+    int cells = 0;
+    int num_rows = imageMap.size();
+    for (int i = 0; i < num_rows; ++i)
+    {
+        int low = 0, high = 0;
+        seamNeighborhood(seam, i, imageMap[i].size(), low, high);
+        for (int j = low; j <= high; ++j)
+        {
+            if (update == ENERGY_BLEND)
+            {
+                energyMap[i][j] = (energyMap[i][j] + pixelEnergy(imageMap, i, j)) / 2;
+            }
+            else
+            {
+                energyMap[i][j] = pixelEnergy(imageMap, i, j);
+            }
+            ++cells;
+        }
+    }
+
+    return cells;
+}
+
+/// @brief The columns of a row whose energy can change when a seam is removed from (or inserted into) an image:
+///        within one column of the seam in that row or the rows directly above and below.
+/// @param seam One column index per row, marking where the seam was removed (or inserted).
+/// @param i The row.
+/// @param columns Width of the image, after the seam was removed (or inserted).
+/// @param low Receives the first column of the span.
+/// @param high Receives the last column of the span.
+void seamNeighborhood(const vector<int> &seam, int i, int columns, int &low, int &high)
+{
+    // the span of seam columns touching this row and its vertical neighbors
+    low = seam[i];
+    high = seam[i];
+    if (i - 1 >= 0)
+    {
+        low = std::min(low, seam[i - 1]);
+        high = std::max(high, seam[i - 1]);
+    }
+    if (i + 1 < seam.size())
+    {
+        low = std::min(low, seam[i + 1]);
+        high = std::max(high, seam[i + 1]);
+    }
+
+    // widen by one column on either side, clamped to the row
+    low = std::max(low - 1, 0);
+    high = std::min(high + 1, columns - 1);
+}
+
+/// @brief Load a precomputed energy (or saliency) map to carve in place of initEnergyMap's gradient.
+/// @param filename A P2 pgm file, whose values are used as-is, or a greyscale (Pf) pfm file, whose values 
+///                 are multiplied by 'scale' and rounded. Either way, negative values are clamped to 0, and large
+///                 ones to INT_MAX over the larger dimension, so that the energy of any seam, vertical or 
+///                 horizontal, fits an int.
+/// @param scale Multiplier for pfm values.
+/// @param imageMap The image the energy map belongs to. Its dimensions must match.
+/// @return The energy map by value.
+vector<vector<int>> loadEnergyMap(const string &filename, double scale, const vector<vector<int>> &imageMap)
+{
+    ifstream energyInputFile(filename, std::ios::binary);
+    if (!energyInputFile)
+    {
+        cerr << "error: could not open energy map '" << filename << "'\n";
+        exit(1);
+    }
+
+    string magic;
+    energyInputFile >> magic;
+
+    vector<vector<int>> result;
+    if (magic == "P2")
+    {
+        energyInputFile.close();
+        result = initImageMap(filename);
+
+        // a high maxval on a tall image could otherwise overflow the cumulative energy sums
+        int ceiling = std::numeric_limits<int>::max() / std::max(result.size(), result[0].size());
+        for (vector<int> &row : result)
+        {
+            for (int &value : row)
+            {
+                value = std::min(value, ceiling);
+            }
+        }
+    }
+    else if (magic == "Pf")
+    {
+        // #REGION parse_pfm
+        // header: "Pf", columns, rows, then a scale whose sign gives the byte order (negative = little endian),
+        // followed by a single whitespace character and the rows of 32-bit floats, stored bottom row first
+        int columns = 0, rows = 0;
+        double byteOrder = 0;
+        energyInputFile >> columns >> rows >> byteOrder;
+        energyInputFile.get();
+
+        if (columns <= 0 || rows <= 0 || !energyInputFile)
+        {
+            cerr << "error: a problem occured in reading the pfm file header of '" << filename << "'\n";
+            exit(1);
+        }
+
+        // the host byte order, to know whether the file's floats need swapping
+        const unsigned int probe = 1;
+        bool hostLittleEndian = *reinterpret_cast<const unsigned char *>(&probe) == 1;
+        bool swapBytes = (byteOrder < 0) != hostLittleEndian;
+
+        result.assign(rows, vector<int>(columns, 0));
+        vector<float> rowData(columns);
+        for (int i = rows - 1; i >= 0; --i)
+        {
+            energyInputFile.read(reinterpret_cast<char *>(rowData.data()), columns * sizeof(float));
+            if (!energyInputFile)
+            {
+                cerr << "error: the pfm file '" << filename << "' ended before all " << rows << " rows were read\n";
+                exit(1);
+            }
+
+            for (int j = 0; j < columns; ++j)
+            {
+                float value = rowData[j];
+                if (swapBytes)
+                {
+                    unsigned char *bytes = reinterpret_cast<unsigned char *>(&value);
+                    std::swap(bytes[0], bytes[3]);
+                    std::swap(bytes[1], bytes[2]);
+                }
+                // clamped before the cast, which is undefined for values out of the int range (NaN counts as 0)
+                double scaled = (double)value * scale;
+                double ceiling = (double)std::numeric_limits<int>::max() / std::max(rows, columns);
+                result[i][j] = scaled > 0 ? (int)std::lround(std::min(scaled, ceiling)) : 0;
+            }
+        }
+        // #ENDREGION
+    }
+    else
+    {
+        cerr << "error: invalid energy map format\n"
+             << "file format was read as '" << magic << "', while the supported formats are 'P2' (pgm) and 'Pf' (greyscale pfm)\n";
+        exit(1);
+    }
+
+    if (result.size() != imageMap.size() || result[0].size() != imageMap[0].size())
+    {
+        cerr << "error: the energy map is " << result[0].size() << "x" << result.size() 
+             << " but the image is " << imageMap[0].size() << "x" << imageMap.size() << "; they must match\n";
+        exit(1);
+    }
+
+    return result;
+}
+
+/// @brief A 2D vector of integers is populated with cumulative energy values using an energy matrix.
+/// @param energyMap The energy map which is used to derive the CE map.
+/// @return The resultant cumulative energy map by value.
+/// @note The lowest energy value in the final row of a CE matrix represents the pixel 
+///       which ends the lowest energy seam.
+vector<vector<int>> initCumulativeEnergyMap(const vector<vector<int>> &energyMap)
+{
+    // initialize result with the contents of the energyMap
+    TRACE_PROBE1(workspace__alloc, (long)(energyMap.size() * energyMap[0].size() * sizeof(int)));
+    vector<vector<int>> result (energyMap);
+
+    /*  objective: for each pixel, act as though this is the end of the seam.
+                   write to result at this indexed pixel, the "cumulative energy"
+                   of itself and the pixel it would have come from. 
+        EX: X comes from 1 (the lowest energy ancestor)
+        +---+---+---+---+
+        | 1 | 2 | 3 | 4 |
+        +---+---+---+---+
+        |   | X |   |   |
+        +---+---+---+---+
+
+        from the perspective of X, we are looking at ... 
+            energyMap[i - 1][j - 1], energyMap[i - 1][j], and energyMap[i - 1][j + 1]
+        
+        bounds checking will need to be done on j
+    */
+
+    for (int i = 1; i < result.size(); ++i)
+    {
+        // outer-for iterates over rows (begin iterating on second row)
+
+        for (int j = 0; j < result[i].size(); ++j) 
+        {
+            // inner-for iterates over individual pixels in each row
+            
+            //#REGION bounds checking
+            // create a list of up to 3 (or 2) seam origin pixels in the row above that can be connected
+            // to the seam pixel in the current row.
+            vector<int> nextSeamPixelCandidates;
+
+            // validate bounds of upper-left
+            if ((j - 1) >= 0) 
+            { 
+                nextSeamPixelCandidates.push_back(result[i - 1][j - 1]);
+            }
+
+            // no need to validate upper
+            nextSeamPixelCandidates.push_back(result[i - 1][j]);
+
+            // validate bounds of upper-right
+            if ((j + 1) < energyMap[i].size()) 
+            { 
+                nextSeamPixelCandidates.push_back(result[i - 1][j + 1]);
+            }
+            //#ENDREGION
+
+            // at this pixel, add to its energy the minimum energy contained within nextSeamPixelCandidates
+            result[i][j] += *std::min_element(nextSeamPixelCandidates.begin(), nextSeamPixelCandidates.end());
+        }
+    }
+
+    return result;
+}
+
+/// @brief Bring a cumulative energy map up to date after a seam has been removed from it and from its energy map
+///        (with the energy next to the seam refreshed), recomputing only the cells whose value can have changed.
+///        A cell can only change if its own energy did, if the seam passed among its three parents, or if one of
+///        its parents changed; so each row recomputes the cells next to the seam plus one column either side of
+///        the cells that changed in the row above, and the region stops growing where the values converge.
+/// @param energyMap The energy map, carved and refreshed next to the seam (see refreshEnergyNearSeam).
+/// @param cumulativeEnergyMap The cumulative energy map of the energy map before the seam was removed, with the
+///                            seam removed from it too. Modified in place to be exactly what
+///                            initCumulativeEnergyMap(energyMap) would return.
+/// @param seam One column index per row, marking where the seam was removed.
+/// @return The number of cumulative energy cells recomputed.
+long long repairCumulativeEnergyMap(const vector<vector<int>> &energyMap, vector<vector<int>> &cumulativeEnergyMap, const vector<int> &seam)
+{
+    int num_rows = energyMap.size();
+    int num_columns = energyMap[0].size();
+    long long cells = 0;
+
+    // the columns of the row above whose value changed (none if changedLow > changedHigh)
+    int changedLow = num_columns, changedHigh = -1;
+    for (int i = 0; i < num_rows; ++i)
+    {
+        // the columns whose energy was refreshed (see seamNeighborhood). they include the columns whose parents
+        // the seam passed among (seam[i - 1] - 1 to seam[i - 1])
+        int low = 0, high = 0;
+        seamNeighborhood(seam, i, num_columns, low, high);
+
+        // and the children of every cell that changed in the row above
+        if (changedLow <= changedHigh)
+        {
+            low = std::max(std::min(low, changedLow - 1), 0);
+            high = std::min(std::max(high, changedHigh + 1), num_columns - 1);
+        }
+
+        changedLow = num_columns;
+        changedHigh = -1;
+        const vector<int> &energy = energyMap[i];
+        vector<int> &cumulative = cumulativeEnergyMap[i];
+        for (int j = low; j <= high; ++j)
+        {
+            int value = energy[j];
+            if (i > 0)
+            {
+                const vector<int> &above = cumulativeEnergyMap[i - 1];
+                int parent = above[j];
+                if (j - 1 >= 0)
+                {
+                    parent = std::min(parent, above[j - 1]);
+                }
+                if (j + 1 < num_columns)
+                {
+                    parent = std::min(parent, above[j + 1]);
+                }
+                value += parent;
+            }
+
+            if (value != cumulative[j])
+            {
+                cumulative[j] = value;
+                changedLow = std::min(changedLow, j);
+                changedHigh = j;
+            }
+        }
+        cells += high - low + 1;
+    }
+
+    return cells;
+}
+
+/// @brief Given the image map and its cumulative energy map, "carve out" the lowest energy seam 
+///        from the image map.
+/// @param imageMap The image map to be modified by the seamCarver.
+/// @param cumulativeEnergyMap The CE map to be traced-back to determine the lowest energy seam.
+void seamCarver(vector<vector<int>> &imageMap, const vector<vector<int>> &cumulativeEnergyMap)
+{
+    // trace-back the lowest energy seam, then snip its pixel out of each row of the image map
+    removeSeam(imageMap, findSeam(cumulativeEnergyMap));
+}
+
+/// @brief Trace-back the lowest energy seam through a cumulative energy map.
+/// @param cumulativeEnergyMap The CE map to be traced-back to determine the lowest energy seam.
+/// @return One column index per row of the map, marking the seam pixel in that row.
+vector<int> findSeam(const vector<vector<int>> &cumulativeEnergyMap)
+{
+    // each element of seam_column_indices corresponds to a row in the image map, 
+    // and contains the column index of the seam pixel in that row.
+    vector<int> seam_column_indices(cumulativeEnergyMap.size(), -1); 
+
+    // get the index of the seam-ending pixel and put at the end of the seam pixel list
+    // the seam-ending pixel is the element in the final row of the cumulativeEnergyMap with the lowest energy
+    int num_rows = cumulativeEnergyMap.size();                                                                                
+    auto seam_end_itr = std::min_element(cumulativeEnergyMap[num_rows - 1].begin(), cumulativeEnergyMap[num_rows - 1].end()); 
+    int seam_end_index = std::distance(cumulativeEnergyMap[num_rows - 1].begin(), seam_end_itr);                              
+    seam_column_indices[num_rows - 1] = seam_end_index;
+
+    // iterate in reverse-row order, descending the seam
+    // for each iteration, trace-back the seam to find the index of the seam pixel connected to it for the next iteration
+    for (int i = cumulativeEnergyMap.size() - 1; i >= 0; --i)
+    {
+        //#REGION find out what the next seam pixel index is for the next iteration
+        if ((i - 1) >= 0)
+        {
+            // if-block only reached if trace-back step doesn't take us out of bounds
+
+            //#REGION bounds checking
+            // create a candidate list of seam pixel indices
+            // that can connect to the seam pixel in the current row.
+
+            // declarations
+            vector<int> nextSeamPixelCandidates; 
+            int indexUpperLeft = seam_column_indices[i] - 1;
+            int indexUpper = seam_column_indices[i];
+            int indexUpperRight = seam_column_indices[i] + 1;
+
+            // validate bounds of upper-left
+            bool upperLeftIsIncluded = false;
+            if ((indexUpperLeft) >= 0) 
+            { 
+                // the connecting seam pixel might be the upper-left pixel
+                nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpperLeft]);
+                upperLeftIsIncluded = true;
+            }
+
+            // no need to validate upper as it will never be out of bounds
+            nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpper]);
+
+            // validate bounds of upper-right
+            bool upperRightIsIncluded = false;
+            if ((indexUpperRight) < cumulativeEnergyMap[i].size()) 
+            { 
+                // the connecting seam pixel might be the upper-right pixel
+                nextSeamPixelCandidates.push_back(cumulativeEnergyMap[i - 1][indexUpperRight]);
+                upperRightIsIncluded = true;
+            }
+
+            // among the candidate seam pixels, find the one with the lowest energy
+            int seam_traceback_value = *std::min_element(nextSeamPixelCandidates.begin(), nextSeamPixelCandidates.end()); 
+            
+            // find the index in the trace-back row of this "lowest energy" pixel.
+            // we need to define a range for out search. start by assuming it includes all three candidate indices
+            int offsetStart = indexUpperLeft;
+            int offsetEnd = indexUpperRight;
+            if (!upperLeftIsIncluded)
+            {
+                // if no upper-left, we are on a left boundary. constrain start of range
+                offsetStart = indexUpper;
+            }
+            
+            if (!upperRightIsIncluded)
+            {
+                // if no upper-right, we're on a right boundary. constrain end of range
+                offsetEnd = indexUpper;
+            }
+            //#ENDREGION
+            
+            // with the defined range to search across, look for the index of the next seam pixel
+            auto seam_traceback_itr = std::find(cumulativeEnergyMap[i - 1].begin() + offsetStart, cumulativeEnergyMap[i - 1].begin() + offsetEnd, seam_traceback_value);
+            int seam_traceback_index = std::distance(cumulativeEnergyMap[i - 1].begin(), seam_traceback_itr);
+
+            // finally, assign this index as the next iterations seam pixel index
+            seam_column_indices[i - 1] = seam_traceback_index;
+        //#ENDREGION
+        }
+    }
+
+    return seam_column_indices;
+}
+
+/// @brief Remove a seam from a map, one pixel per row.
+/// @param map The map to be modified. Each row shrinks by one column.
+/// @param seam One column index per row of the map, as produced by findSeam.
+void removeSeam(vector<vector<int>> &map, const vector<int> &seam)
+{
+    for (int i = 0; i < map.size(); ++i)
+    {
+        // Remove the seam pixel from the current row by swapping it with adjacent pixels
+        // until it reaches the end of the row, and then "snipping" it off from the end.
+        int seam_pixel_index = seam[i];
+        while (seam_pixel_index + 1 < map[i].size())
+        {
+            // while-loop swaps the seam pixel until it is at the end of the row 
+            std::swap(map[i][seam_pixel_index], map[i][seam_pixel_index + 1]);
+            ++seam_pixel_index;
+        }
+        map[i].pop_back();
+    }
+}
+
+/// @brief Total energy along a seam.
+/// @param energyMap The energy map the seam runs through.
+/// @param seam One column index per row.
+/// @return The sum of the energy of every seam pixel.
+long long seamEnergy(const vector<vector<int>> &energyMap, const vector<int> &seam)
+{
+    long long total = 0;
+    for (int i = 0; i < energyMap.size(); ++i)
+    {
+        total += energyMap[i][seam[i]];
+    }
+
+    return total;
+}
+
+/// @brief Wall-clock seconds elapsed since 'start'.
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Remove the same seam from an image and from every image carved jointly with it, in one pass over the rows.
+/// @param imageMap The first image. Each row shrinks by one column.
+/// @param jointMaps The other images. Each row of each shrinks by one column.
+/// @param seam One column index per row, as produced by findSeam.
+void removeSeamJoint(vector<vector<int>> &imageMap, vector<vector<vector<int>>> &jointMaps, const vector<int> &seam)
+{
+    for (int i = 0; i < imageMap.size(); ++i)
+    {
+        imageMap[i].erase(imageMap[i].begin() + seam[i]);
+        for (vector<vector<int>> &jointMap : jointMaps)
+        {
+            jointMap[i].erase(jointMap[i].begin() + seam[i]);
+        }
+    }
+}
+
+/// @brief Remove a seam from a map, one pixel per row, keeping the removed values.
+/// @param map The map to be modified. Each row shrinks by one column.
+/// @param seam One column index per row of the map, as produced by findSeam.
+/// @return The removed value from each row, in row order.
+vector<int> extractSeam(vector<vector<int>> &map, const vector<int> &seam)
+{
+    vector<int> values(map.size());
+    for (int i = 0; i < map.size(); ++i)
+    {
+        values[i] = map[i][seam[i]];
+        map[i].erase(map[i].begin() + seam[i]);
+    }
+
+    return values;
+}
+
+/// @brief Put a seam back into a map. The inverse of extractSeam.
+/// @param map The map to be modified. Each row grows by one column.
+/// @param seam One column index per row, at which the value is to be inserted.
+/// @param values The value to insert into each row.
+void insertSeam(vector<vector<int>> &map, const vector<int> &seam, const vector<int> &values)
+{
+    for (int i = 0; i < map.size(); ++i)
+    {
+        map[i].insert(map[i].begin() + seam[i], values[i]);
+    }
+}
+
+/// @brief Find the lowest energy seam with a meet-in-the-middle DP. A top-down cumulative energy pass over the 
+///        upper half and a bottom-up pass over the lower half run on separate threads; the two are joined at 
+///        the middle row, and the seam is then traced outward from there in both directions. (With only one CPU
+///        available, see detectResourceLimits, or a map under CONCURRENT_DP_CELLS, the halves simply run one
+///        after the other: the thread would cost more than it saves.)
+/// @param energyMap The energy map in which to find the seam.
+/// @return One column index per row of the map, marking the seam pixel in that row.
+/// @note The seam returned has the same (minimal) total energy as the one findSeam would return, though a 
+///       different seam may be chosen when several seams tie for the lowest energy.
+vector<int> findSeamBidirectional(const vector<vector<int>> &energyMap)
+{
+    int num_rows = energyMap.size();
+    int num_columns = energyMap[0].size();
+
+    if (num_rows < 4)
+    {
+        // too few rows to be worth splitting; carve the usual way
+        return findSeam(initCumulativeEnergyMap(energyMap));
+    }
+
+    // rows [0, middle] are accumulated top-down, rows [middle, num_rows - 1] bottom-up.
+    // the middle row belongs to both halves, so each half keeps its own copy of it.
+    int middle = num_rows / 2;
+    vector<vector<int>> topDown;
+    vector<vector<int>> bottomUp;
+    TRACE_PROBE1(workspace__alloc, (long)(num_rows + 1) * num_columns * sizeof(int));
+
+    // accumulates one half of the map. 'rows' is walked from rows[first] in direction 'step', 
+    // each row adding to itself the minimum of the (up to 3) connecting cells of the row before it
+    auto accumulate = [num_columns](vector<vector<int>> &rows, int first, int last, int step)
+    {
+        for (int i = first + step; i != last + step; i += step)
+        {
+            const vector<int> &previous = rows[i - step];
+            for (int j = 0; j < num_columns; ++j)
+            {
+                int best = previous[j];
+                if (j - 1 >= 0)
+                {
+                    best = std::min(best, previous[j - 1]);
+                }
+                if (j + 1 < num_columns)
+                {
+                    best = std::min(best, previous[j + 1]);
+                }
+                rows[i][j] += best;
+            }
+        }
+    };
+
+    //#REGION cumulative energy, both halves at once
+    runConcurrently([&]()
+    {
+        // bottomUp[k] holds row (middle + k)
+        bottomUp.assign(energyMap.begin() + middle, energyMap.end());
+        accumulate(bottomUp, bottomUp.size() - 1, 0, -1);
+    },
+    [&]()
+    {
+        topDown.assign(energyMap.begin(), energyMap.begin() + middle + 1);
+        accumulate(topDown, 0, middle, 1);
+    }, (long long)num_rows * num_columns >= CONCURRENT_DP_CELLS);
+    //#ENDREGION
+
+    //#REGION meet in the middle
+    // the cheapest seam through (middle, j) costs topDown + bottomUp at j, less the pixel's own energy 
+    // which both halves counted
+    int seam_middle_index = 0;
+    long long seam_energy = -1;
+    for (int j = 0; j < num_columns; ++j)
+    {
+        long long through = (long long)topDown[middle][j] + bottomUp[0][j] - energyMap[middle][j];
+        if (seam_energy < 0 || through < seam_energy)
+        {
+            seam_energy = through;
+            seam_middle_index = j;
+        }
+    }
+    //#ENDREGION
+
+    //#REGION trace-back outward from the middle row
+    vector<int> seam_column_indices(num_rows, -1);
+    seam_column_indices[middle] = seam_middle_index;
+
+    // steps from the seam pixel at 'from_index' to the lowest energy connecting cell in the adjacent row 'to'
+    auto step = [num_columns](const vector<int> &to, int from_index)
+    {
+        int best_index = from_index;
+        if (from_index - 1 >= 0 && to[from_index - 1] <= to[best_index])
+        {
+            best_index = from_index - 1;
+        }
+        if (from_index + 1 < num_columns && to[from_index + 1] < to[best_index])
+        {
+            best_index = from_index + 1;
+        }
+        return best_index;
+    };
+
+    // a step per row is far too little work to hand to another thread
+    for (int i = middle + 1; i < num_rows; ++i)
+    {
+        seam_column_indices[i] = step(bottomUp[i - middle], seam_column_indices[i - 1]);
+    }
+    for (int i = middle - 1; i >= 0; --i)
+    {
+        seam_column_indices[i] = step(topDown[i], seam_column_indices[i + 1]);
+    }
+    //#ENDREGION
+
+    return seam_column_indices;
+}
+
+/// @brief Find the lowest energy seam in an energy map by whichever method the options select.
+/// @param energyMap The energy map in which to find the seam.
+/// @param options The carving options.
+/// @return One column index per row of the map, marking the seam pixel in that row.
+vector<int> findLowestEnergySeam(const vector<vector<int>> &energyMap, const CarveOptions &options)
+{
+    if (options.bidirectional)
+    {
+        // find the seam from both ends at once
+        return findSeamBidirectional(energyMap);
+    }
+
+    // INITIALIZE THE CUMULATIVE ENERGY MAP, then trace-back the seam through it
+    return findSeam(initCumulativeEnergyMap(energyMap));
+}
+
+/// @brief Transpose a given 2D vector, tile by tile on all available CPUs (see runTiles).
+/// @param imageMap 2D vector to transpose. Original is modified.
+/// @param threads Most threads to use (see runTiles).
+void transposeMap(vector<vector<int>> &imageMap, int threads)
+{
+    // the transpose map will need as many rows as imageMap has columns
+    int rows = imageMap.size(), columns = imageMap[0].size();
+    vector<vector<int>> transpose(columns, vector<int>(rows));
+
+    // Ex)
+    // row: [1 2 3] of imageMap becomes
+    //
+    // column: [1]
+    //         [2]
+    //         [3]
+    runTiles(rows, columns, [&](int top, int left, int tileRows, int tileColumns)
+    {
+        transposeBlock(imageMap, transpose, top, left, tileRows, tileColumns);
+    }, threads);
+
+    imageMap.swap(transpose);
+
+    return;
+}
+
+/// @brief Transpose one tile of a 2D vector into another: destination[left + j][top + i] = source[top + i][left + j].
+///        With SSE2, 4x4 blocks are transposed in registers, four rows loaded and four stored at a time.
+/// @param source The 2D vector to read from.
+/// @param destination The 2D vector to write to, already sized as the transpose of source.
+/// @param top First row of the tile, in source.
+/// @param left First column of the tile, in source.
+/// @param rows Rows of the tile.
+/// @param columns Columns of the tile.
+void transposeBlock(const vector<vector<int>> &source, vector<vector<int>> &destination, int top, int left, int rows, int columns)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= rows; i += 4)
+    {
+        int j = 0;
+        for (; j + 4 <= columns; j += 4)
+        {
+            __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[top + i][left + j]));
+            __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[top + i + 1][left + j]));
+            __m128i row2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[top + i + 2][left + j]));
+            __m128i row3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&source[top + i + 3][left + j]));
+
+            __m128i low01 = _mm_unpacklo_epi32(row0, row1);   // a0 b0 a1 b1
+            __m128i low23 = _mm_unpacklo_epi32(row2, row3);   // c0 d0 c1 d1
+            __m128i high01 = _mm_unpackhi_epi32(row0, row1);  // a2 b2 a3 b3
+            __m128i high23 = _mm_unpackhi_epi32(row2, row3);  // c2 d2 c3 d3
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&destination[left + j][top + i]), _mm_unpacklo_epi64(low01, low23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&destination[left + j + 1][top + i]), _mm_unpackhi_epi64(low01, low23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&destination[left + j + 2][top + i]), _mm_unpacklo_epi64(high01, high23));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&destination[left + j + 3][top + i]), _mm_unpackhi_epi64(high01, high23));
+        }
+        for (; j < columns; ++j)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                destination[left + j][top + i + k] = source[top + i + k][left + j];
+            }
+        }
+    }
+#endif
+    for (; i < rows; ++i)
+    {
+        for (int j = 0; j < columns; ++j)
+        {
+            destination[left + j][top + i] = source[top + i][left + j];
+        }
+    }
+}
+
+/// @brief Transpose a 64x64 matrix of bits in place: bit c of block[r] moves to bit r of block[c]. Quadrants are
+///        swapped recursively, 32x32 then 16x16 down to 1x1, each level a masked shift and XOR over whole words.
+/// @param block The matrix, a row of 64 bits to a word.
+void transposeBits64(uint64_t block[64])
+{
+    uint64_t mask = 0x00000000FFFFFFFFULL;
+    for (int width = 32; width != 0; width >>= 1, mask ^= mask << width)
+    {
+        for (int k = 0; k < 64; k = ((k | width) + 1) & ~width)
+        {
+            uint64_t swapped = ((block[k] >> width) ^ block[k | width]) & mask;
+            block[k] ^= swapped << width;
+            block[k | width] ^= swapped;
+        }
+    }
+}
+
+/// @brief Display a 2D vector.
+/// @param map The 2D vector to be displayed. 
+void displayMap(const vector<vector<int>> &map)
+{
+    for (const vector<int>& row : map)
+    {
+        for (int pixel : row)
+        {
+            if (pixel < 10)
+            {
+                cout << "  000" << pixel;
+            }
+            else if (pixel < 100)
+            {
+                cout << "  00" << pixel;
+            }
+            else if (pixel < 1000)
+            {
+                cout << "  0" << pixel;
+            }
+            else
+            {
+                cout << "  " << pixel;
+            }
+        }
+        cout << "\n\n";
+    }
+
+    return;
+}
+
+/// @brief Helper. Utilize existing functions to display the transpose of a map 
+///        without modifying the original.
+/// @param map The 2D vector whose transpose is to be displayed.
+void displayTranspose(const vector<vector<int>> &map)
+{
+    vector<vector<int>> temp(map);
+
+    // transposes the temporary copy and displays it
+    transposeMap(temp);
+    displayMap(temp);
+
+    return;
+}
+
+/// @brief Validate command-line args for the number of seams to remove are within the acceptable range.
+/// @param imageMap The image map for which the seam carving requests are to be completed on.
+/// @param num_vertical_seams Number of vertical seams to remove. If outside range [0, imageMap(num_columns) - 1], the request is invalid.
+/// @param num_horizontal_seams Number of horizontal seams to remove. If outside range [0, imageMap(num_rows) - 1], the request is invalid.
+void validateCarveRequests(const vector<vector<int>> &imageMap, int num_vertical_seams, int num_horizontal_seams)
+{
+    // validate vertical seam request
+    if (num_vertical_seams < 0)
+    {
+        cerr << "error: requested number of vertical seams to carve must be greater than or equal to 0\n";
+        exit(1);
+    }
+    if (num_vertical_seams >= imageMap[0].size())
+    {
+        cerr << "error: the requested number of vertical seams to carve is " << num_vertical_seams << ", which is invalid.\n"
+             << "the provided image is " << imageMap[0].size() << " pixels wide. to carve the requested number of vertical seams would be to\n"
+             << "erase the image entirely\n";
+        exit(1);
+    }
+
+    // validate horizontal seam request
+    if (num_horizontal_seams < 0)
+    {
+        cerr << "error: requested number of horizontal seams to carve must be greater than or equal to 0\n";
+        exit(1);
+    }
+    if (num_horizontal_seams >= imageMap.size())
+    {
+        cerr << "error: the requested number of horizontal seams to carve is " << num_horizontal_seams << ", which is invalid.\n"
+             << "the provided image is " << imageMap.size() << " pixels tall. to carve the requested number of horizontal seams would be to\n"
+             << "erase the image entirely\n";
+        exit(1);
+    }
+
+    return;
+}
+
+/// @brief Peak signal-to-noise ratio of an image against a reference of the same size, with the reference's
+///        largest value as the peak.
+/// @param imageMap The image.
+/// @param referenceMap The reference.
+/// @return The PSNR in dB, or infinity if the images are identical.
+double peakSignalToNoise(const vector<vector<int>> &imageMap, const vector<vector<int>> &referenceMap)
+{
+    double squaredError = 0;
+    int peak = 1;
+    for (int i = 0; i < referenceMap.size(); ++i)
+    {
+        for (int j = 0; j < referenceMap[i].size(); ++j)
+        {
+            double difference = imageMap[i][j] - referenceMap[i][j];
+            squaredError += difference * difference;
+            peak = std::max(peak, referenceMap[i][j]);
+        }
+    }
+    double meanSquaredError = squaredError / ((double)referenceMap.size() * referenceMap[0].size());
+
+    return meanSquaredError == 0 ? INFINITY : 10 * std::log10((double)peak * peak / meanSquaredError);
+}
+
+/// @brief Mean structural similarity (SSIM) of an image against a reference of the same size, over 8x8 windows
+///        taken every 4 pixels, with the reference's largest value as the dynamic range.
+/// @param imageMap The image.
+/// @param referenceMap The reference.
+/// @return The SSIM, 1 for identical (or empty) images.
+double structuralSimilarity(const vector<vector<int>> &imageMap, const vector<vector<int>> &referenceMap)
+{
+    int rows = referenceMap.size(), columns = rows > 0 ? referenceMap[0].size() : 0;
+    int window = std::min(8, std::min(rows, columns));
+    int peak = 1;
+    for (const vector<int> &row : referenceMap)
+    {
+        peak = std::max(peak, *std::max_element(row.begin(), row.end()));
+    }
+    double c1 = (0.01 * peak) * (0.01 * peak), c2 = (0.03 * peak) * (0.03 * peak);
+
+    double total = 0;
+    int windows = 0;
+    for (int top = 0; top + window <= rows; top += 4)
+    {
+        for (int left = 0; left + window <= columns; left += 4)
+        {
+            double sumX = 0, sumY = 0, sumXX = 0, sumYY = 0, sumXY = 0;
+            for (int i = top; i < top + window; ++i)
+            {
+                for (int j = left; j < left + window; ++j)
+                {
+                    double x = imageMap[i][j], y = referenceMap[i][j];
+                    sumX += x;
+                    sumY += y;
+                    sumXX += x * x;
+                    sumYY += y * y;
+                    sumXY += x * y;
+                }
+            }
+            double n = window * window;
+            double meanX = sumX / n, meanY = sumY / n;
+            double varianceX = sumXX / n - meanX * meanX, varianceY = sumYY / n - meanY * meanY;
+            double covariance = sumXY / n - meanX * meanY;
+
+            total += (2 * meanX * meanY + c1) * (2 * covariance + c2)
+                   / ((meanX * meanX + meanY * meanY + c1) * (varianceX + varianceY + c2));
+            ++windows;
+        }
+    }
+
+    // an empty image has no windows to differ in
+    return windows > 0 ? total / windows : 1.0;
+}
+
+/// @brief  Write the seam-carved image map to a file. 
+/// @param imageMap The image map that has been modified by the seam carving algorithm.
+/// @param filename Name of the file to write the results to.
+void writeResults(const vector<vector<int>> &imageMap, const string &filename)
+{
+    ofstream outFile(filename);
+
+    outFile << "P2\n"; // for pgm file type
+    outFile << "# Processed by Seam Carving Inc.\n"; // Seam Carving Incorporated!!!
+    outFile << imageMap[0].size() << " " << imageMap.size() << "\n";  // first the # columns, then # rows, to match pgm file format for irfanview
+
+    // we need to iterate through the imageMap and find the maximum value
+    int max_val = imageMap[0][0];
+    for (const auto& row : imageMap) 
+    {
+        for (auto val : row) 
+        {
+            if (val > max_val) 
+            {
+                max_val = val;
+            }
+        }
+    }
+    outFile << max_val << "\n";
+
+    // write processed image map
     for (int i = 0; i < imageMap.size(); ++i)
     {
-        for (int j = 0; j < imageMap[0].size(); ++j)
+        for (int j = 0; j < imageMap[0].size(); ++j)
+        {
+            outFile << imageMap[i][j] << " ";
+        }
+        outFile << "\n";
+    }
+
+    return;
+}
+
+
+/// @brief Derive the name a processed image is written to.
+/// @param fullname Name of the source pgm file.
+/// @param num_vertical_seams Number of vertical seams removed.
+/// @param num_horizontal_seams Number of horizontal seams removed.
+/// @return ex) example.pgm, 10, 5  --->  example_processed_10_5.pgm
+string processedFilename(const string &fullname, int num_vertical_seams, int num_horizontal_seams)
+{
+    // get the raw file name
+    string rawname = fullname.substr(0, fullname.find_last_of("."));
+
+    return rawname + "_processed_" + std::to_string(num_vertical_seams) + "_" + std::to_string(num_horizontal_seams) + ".pgm";
+}
+
+/// @brief A 64-bit difference hash (dHash) of an image: the image is box-averaged down to 9x8 cells, and each
+///        bit records whether a cell is darker than its right-hand neighbor. Re-encodes, light crops and small
+///        overlays such as watermarks change only a few bits.
+/// @param imageMap The image to hash.
+/// @return The hash. Near-duplicates differ in few bits (see findNearDuplicate).
+unsigned long long perceptualHash(const vector<vector<int>> &imageMap)
+{
+    const int cells_x = 9, cells_y = 8;
+    int num_rows = imageMap.size();
+    int num_columns = imageMap[0].size();
+
+    // average of each cell. tiny images repeat pixels across cells
+    double cells[cells_y][cells_x];
+    for (int cy = 0; cy < cells_y; ++cy)
+    {
+        int row_begin = cy * num_rows / cells_y;
+        int row_end = std::max((cy + 1) * num_rows / cells_y, row_begin + 1);
+        for (int cx = 0; cx < cells_x; ++cx)
+        {
+            int column_begin = cx * num_columns / cells_x;
+            int column_end = std::max((cx + 1) * num_columns / cells_x, column_begin + 1);
+
+            long long sum = 0;
+            for (int i = row_begin; i < row_end; ++i)
+            {
+                for (int j = column_begin; j < column_end; ++j)
+                {
+                    sum += imageMap[i][j];
+                }
+            }
+            cells[cy][cx] = (double)sum / ((row_end - row_begin) * (column_end - column_begin));
+        }
+    }
+
+    unsigned long long hash = 0;
+    for (int cy = 0; cy < cells_y; ++cy)
+    {
+        for (int cx = 0; cx + 1 < cells_x; ++cx)
+        {
+            hash = (hash << 1) | (cells[cy][cx] < cells[cy][cx + 1] ? 1 : 0);
+        }
+    }
+
+    return hash;
+}
+
+/// @brief Look up the seam index for an image carved before that is a near-duplicate of this one.
+///        The index is the file 'index.txt' in 'directory', one line per carved image:
+///            hash(hex) columns rows vertical_seams horizontal_seams seam_file
+///        and each seam file holds one seam per line:
+///            V|H energy column_0 column_1 ... column_(rows - 1)
+/// @param directory The seam index directory.
+/// @param hash perceptualHash of the image.
+/// @param imageMap The image. A match must have exactly the same dimensions: the index keeps no crop offsets, so
+///                 a cropped copy of an indexed image is never matched and is carved in full.
+/// @param num_vertical_seams A match must have carved this many vertical seams...
+/// @param num_horizontal_seams ...and this many horizontal seams.
+/// @param maxDistance The most hash bits in which a match may differ.
+/// @param seams Receives the matched image's seams, in the order they were carved.
+/// @return true if a match was found.
+bool findNearDuplicate(const string &directory, unsigned long long hash, const vector<vector<int>> &imageMap, 
+                       int num_vertical_seams, int num_horizontal_seams, int maxDistance, vector<SeamRecord> &seams)
+{
+    ifstream indexFile(directory + "/index.txt");
+    if (!indexFile)
+    {
+        // nothing indexed yet
+        return false;
+    }
+
+    // the closest match wins
+    string bestSeamFile;
+    int bestDistance = maxDistance + 1;
+
+    string line;
+    while (getline(indexFile, line))
+    {
+        stringstream entry(line);
+        unsigned long long entryHash = 0;
+        int columns = 0, rows = 0, vertical = 0, horizontal = 0;
+        string seamFile;
+        entry >> std::hex >> entryHash >> std::dec >> columns >> rows >> vertical >> horizontal >> seamFile;
+        if (!entry || columns != imageMap[0].size() || rows != imageMap.size() 
+            || vertical != num_vertical_seams || horizontal != num_horizontal_seams)
+        {
+            continue;
+        }
+
+        int distance = __builtin_popcountll(entryHash ^ hash);
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            bestSeamFile = seamFile;
+        }
+    }
+
+    if (bestSeamFile.empty())
+    {
+        return false;
+    }
+
+    ifstream seamInputFile(directory + "/" + bestSeamFile);
+    seams.clear();
+    while (getline(seamInputFile, line))
+    {
+        stringstream entry(line);
+        string orientation;
+        SeamRecord seam;
+        entry >> orientation >> seam.energy;
+        seam.horizontal = orientation == "H";
+
+        int column = 0;
+        while (entry >> column)
+        {
+            seam.columns.push_back(column);
+        }
+        seams.push_back(seam);
+    }
+
+    return seams.size() == num_vertical_seams + num_horizontal_seams;
+}
+
+/// @brief The total energy of a sequence of seams, each measured on the exact energy of the image it is carved
+///        from (for comparing an approximate carve with an exact one).
+/// @param imageMap The image before carving. Taken by value; carved here.
+/// @param seams The seams to carve, in order: vertical seams, then horizontal ones.
+/// @return The sum of the seams' energies.
+long long exactSeamsEnergy(vector<vector<int>> imageMap, const vector<SeamRecord> &seams)
+{
+    vector<vector<int>> energyMap = initEnergyMap(imageMap);
+    bool transposed = false;
+    long long total = 0;
+
+    for (const SeamRecord &seam : seams)
+    {
+        if (seam.horizontal && !transposed)
+        {
+            transposeMap(imageMap);
+            transposeMap(energyMap);
+            transposed = true;
+        }
+
+        // the energy kept next to each seam is recomputed, so it stays exact
+        total += seamEnergy(energyMap, seam.columns);
+        removeSeam(imageMap, seam.columns);
+        removeSeam(energyMap, seam.columns);
+        refreshEnergyNearSeam(imageMap, energyMap, seam.columns);
+    }
+
+    return total;
+}
+
+/// @brief Carve a near-duplicate's seams out of an image without any DP. Each seam is first checked against
+///        the image's own (incrementally maintained) energy: it must still be a connected seam within bounds,
+///        and its energy must not exceed by more than 'tolerance' either what it was when originally carved or
+///        the energy of a greedy seam through this image (see greedySeamEnergy). The latter catches a seam
+///        whose energy is unchanged but which this image's own seams beat, e.g. around a moved watermark.
+/// @param imageMap The image to carve. Modified, and left part-way carved if a seam fails its check, 
+///                 so pass a copy that can be discarded.
+/// @param seams The seams to carve, in order: vertical seams, then horizontal ones.
+/// @param tolerance The largest acceptable relative rise in a seam's energy, e.g. 0.1 for 10%.
+/// @return true if every seam passed its check and was carved.
+bool replaySeams(vector<vector<int>> &imageMap, const vector<SeamRecord> &seams, double tolerance)
+{
+    vector<vector<int>> energyMap = initEnergyMap(imageMap);
+    bool transposed = false;
+
+    for (const SeamRecord &seam : seams)
+    {
+        if (seam.horizontal && !transposed)
+        {
+            // the energy of the transpose is the transpose of the energy, so both can simply be transposed
+            transposeMap(imageMap);
+            transposeMap(energyMap);
+            transposed = true;
+        }
+
+        //#REGION verify the seam against this image
+        if (seam.columns.size() != imageMap.size())
+        {
+            return false;
+        }
+        for (int i = 0; i < seam.columns.size(); ++i)
+        {
+            if (seam.columns[i] < 0 || seam.columns[i] >= imageMap[i].size() 
+                || (i > 0 && abs(seam.columns[i] - seam.columns[i - 1]) > 1))
+            {
+                return false;
+            }
+        }
+        long long energy = seamEnergy(energyMap, seam.columns);
+        if (energy > seam.energy * (1.0 + tolerance) || energy > greedySeamEnergy(energyMap) * (1.0 + tolerance))
+        {
+            return false;
+        }
+        //#ENDREGION
+
+        removeSeam(imageMap, seam.columns);
+        removeSeam(energyMap, seam.columns);
+        refreshEnergyNearSeam(imageMap, energyMap, seam.columns);
+    }
+
+    if (transposed)
+    {
+        transposeMap(imageMap); // undo the transpose
+    }
+
+    return true;
+}
+
+/// @brief The energy of a greedy seam: from the lowest energy pixel of the first row, each row steps to the
+///        lowest energy of the (up to) three pixels below. An upper bound on the lowest seam energy, in
+///        O(rows + columns) rather than a DP's O(rows * columns).
+/// @param energyMap The energy map.
+/// @return The total energy along the greedy seam.
+long long greedySeamEnergy(const vector<vector<int>> &energyMap)
+{
+    int column = std::distance(energyMap[0].begin(), std::min_element(energyMap[0].begin(), energyMap[0].end()));
+    long long total = energyMap[0][column];
+    for (int i = 1; i < energyMap.size(); ++i)
+    {
+        int next = column;
+        if (column - 1 >= 0 && energyMap[i][column - 1] < energyMap[i][next])
+        {
+            next = column - 1;
+        }
+        if (column + 1 < energyMap[i].size() && energyMap[i][column + 1] < energyMap[i][next])
+        {
+            next = column + 1;
+        }
+        column = next;
+        total += energyMap[i][column];
+    }
+
+    return total;
+}
+
+/// @brief Record an image's seams in the seam index (see findNearDuplicate for the layout).
+/// @param directory The seam index directory. Created if it does not exist.
+/// @param hash perceptualHash of the image, before carving.
+/// @param columns Columns of the image, before carving.
+/// @param rows Rows of the image, before carving.
+/// @param num_vertical_seams Number of vertical seams carved.
+/// @param num_horizontal_seams Number of horizontal seams carved.
+/// @param seams The seams, in the order they were carved.
+void addToSeamIndex(const string &directory, unsigned long long hash, int columns, int rows, 
+                    int num_vertical_seams, int num_horizontal_seams, const vector<SeamRecord> &seams)
+{
+    mkdir(directory.c_str(), 0755);
+
+    stringstream hexHash;
+    hexHash << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+    string seamFile = hexHash.str() + "_" + std::to_string(columns) + "x" + std::to_string(rows) + "_" 
+                    + std::to_string(num_vertical_seams) + "_" + std::to_string(num_horizontal_seams) + ".seams";
+
+    // an image with the same hash, size and seam counts replaces the earlier one's seams but keeps its index line
+    struct stat existing;
+    bool alreadyIndexed = stat((directory + "/" + seamFile).c_str(), &existing) == 0;
+
+    ofstream seamOutputFile(directory + "/" + seamFile);
+    for (const SeamRecord &seam : seams)
+    {
+        seamOutputFile << (seam.horizontal ? "H" : "V") << " " << seam.energy;
+        for (int column : seam.columns)
+        {
+            seamOutputFile << " " << column;
+        }
+        seamOutputFile << "\n";
+    }
+    seamOutputFile.close();
+
+    if (!seamOutputFile)
+    {
+        cerr << "warning: could not write to the seam index '" << directory << "'\n";
+        return;
+    }
+    if (alreadyIndexed)
+    {
+        return;
+    }
+
+    ofstream indexFile(directory + "/index.txt", std::ios::app);
+    indexFile << hexHash.str() << " " << columns << " " << rows << " " 
+              << num_vertical_seams << " " << num_horizontal_seams << " " << seamFile << "\n";
+}
+
+// #REGION coalescing
+// concurrent invocations carving the same input with the same parameters share one carve. every request first 
+// joins the key's group with a shared lock on DIR/KEY.group; the first to take the exclusive lock DIR/KEY.lock 
+// carves, and the rest block on that lock until it has published DIR/KEY.pgm, then copy that instead. both are 
+// flock(2) locks, so the kernel releases them should their holder die. the last member to leave a group removes 
+// its files, so DIR only ever holds the results of carves still being shared.
+
+// this process's membership of a coalescing group: its lock files, and DIR/KEY for cleaning up
+static int coalesceGroupFd = -1;
+static int coalesceLockFd = -1;
+static string coalescePrefix;
+
+/// @brief Release the coalescing lock, if held, so a waiting request can take over, and leave the group. The last
+///        member to leave removes the group's result and lock files.
+static void leaveCoalesceGroup()
+{
+    if (coalesceLockFd >= 0)
+    {
+        close(coalesceLockFd);
+        coalesceLockFd = -1;
+    }
+    if (coalesceGroupFd < 0)
+    {
+        return;
+    }
+
+    // the exclusive lock is only granted once no other member holds its shared one. the group file is removed 
+    // while still locked, so a request that opened it just before notices and starts a new group
+    if (flock(coalesceGroupFd, LOCK_EX | LOCK_NB) == 0)
+    {
+        unlink((coalescePrefix + ".pgm").c_str());
+        unlink((coalescePrefix + ".lock").c_str());
+        unlink((coalescePrefix + ".group").c_str());
+    }
+    close(coalesceGroupFd);
+    coalesceGroupFd = -1;
+}
+
+/// @brief Copy a file.
+/// @return true on success.
+static bool copyFile(const string &from, const string &to)
+{
+    ifstream in(from, std::ios::binary);
+    ofstream out(to, std::ios::binary);
+    out << in.rdbuf();
+    return in && out;
+}
+
+/// @brief Copy the files of a directory (not its subdirectories) into another, created if need be.
+/// @return true on success. A missing source directory copies nothing and fails.
+static bool copyDirectory(const string &from, const string &to)
+{
+    DIR *source = opendir(from.c_str());
+    if (source == nullptr)
+    {
+        return false;
+    }
+    mkdir(to.c_str(), 0755);
+
+    bool copied = true;
+    for (struct dirent *entry = readdir(source); entry != nullptr; entry = readdir(source))
+    {
+        struct stat status;
+        string path = from + "/" + entry->d_name;
+        if (stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode))
+        {
+            copied = copyFile(path, to + "/" + entry->d_name) && copied;
+        }
+    }
+    closedir(source);
+
+    return copied;
+}
+
+/// @brief Remove a directory of files (as made by copyDirectory). A missing directory is not an error.
+static void removeDirectory(const string &directory)
+{
+    DIR *contents = opendir(directory.c_str());
+    if (contents == nullptr)
+    {
+        return;
+    }
+    for (struct dirent *entry = readdir(contents); entry != nullptr; entry = readdir(contents))
+    {
+        if (string(entry->d_name) != "." && string(entry->d_name) != "..")
+        {
+            unlink((directory + "/" + entry->d_name).c_str());
+        }
+    }
+    closedir(contents);
+    rmdir(directory.c_str());
+}
+
+/// @brief Fold the bytes of a file into a 64-bit FNV-1a hash.
+/// @param filename The file to hash. A missing file contributes nothing.
+/// @param hash The hash so far (the FNV offset basis, 14695981039346656037, to begin).
+/// @return The updated hash.
+unsigned long long hashFile(const string &filename, unsigned long long hash)
+{
+    ifstream in(filename, std::ios::binary);
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+    {
+        for (std::streamsize k = 0; k < in.gcount(); ++k)
+        {
+            hash = (hash ^ (unsigned char)buffer[k]) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+/// @brief The coalescing key of this invocation: a hash of the input image's (and any precomputed 
+///        energy map's) contents, together with every other argument. The input path itself is left out, 
+///        so identical content under different names still coalesces.
+/// @return The key, as 16 hex digits.
+string coalesceKey(int argc, char* argv[], const CarveOptions &options)
+{
+    unsigned long long hash = hashFile(argv[1], 14695981039346656037ULL);
+    if (!options.energyFile.empty())
+    {
+        hash = hashFile(options.energyFile, hash);
+    }
+    for (int i = 2; i < argc; ++i)
+    {
+        for (const char *c = argv[i]; ; ++c)
+        {
+            // arguments are folded in with their terminating nulls, so "1 23" and "12 3" differ
+            hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+            if (*c == '\0')
+            {
+                break;
+            }
+        }
+    }
+
+    stringstream hexHash;
+    hexHash << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hexHash.str();
+}
+
+/// @brief Either take the lock for a key, or wait for the request holding it and copy its result.
+/// @param directory The coalescing directory. Created if it does not exist.
+/// @param key The coalescing key (see coalesceKey).
+/// @param fileToWrite Where the result goes, if it is copied.
+/// @return true if this process holds the lock and must carve (then call coalescePublish), 
+///         false if the result has already been copied to fileToWrite.
+/// @note Waiting requests block in flock rather than polling. A holder that exits without publishing, or is 
+///       killed outright, loses its lock to the kernel, and a waiting request then takes over the carve; so
+///       however long a live carve runs, its lock is never broken.
+bool coalesceAcquire(const string &directory, const string &key, const string &fileToWrite)
+{
+    mkdir(directory.c_str(), 0755);
+    coalescePrefix = directory + "/" + key;
+    string groupFile = coalescePrefix + ".group", lockFile = coalescePrefix + ".lock", resultFile = coalescePrefix + ".pgm";
+    atexit(leaveCoalesceGroup);
+
+    // JOIN THE GROUP, unless its last member removed the group file between our open and our lock
+    while (true)
+    {
+        coalesceGroupFd = open(groupFile.c_str(), O_CREAT | O_RDWR, 0644);
+        if (coalesceGroupFd < 0)
+        {
+            cerr << "error: could not create '" << groupFile << "'\n";
+            exit(1);
+        }
+        flock(coalesceGroupFd, LOCK_SH);
+
+        struct stat opened, current;
+        if (fstat(coalesceGroupFd, &opened) == 0 && stat(groupFile.c_str(), &current) == 0 
+            && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino)
+        {
+            break;
+        }
+        close(coalesceGroupFd);
+    }
+
+    // TAKE THE LOCK, or wait on the request holding it
+    struct stat status;
+    coalesceLockFd = open(lockFile.c_str(), O_CREAT | O_RDWR, 0644);
+    if (coalesceLockFd < 0)
+    {
+        cerr << "error: could not create '" << lockFile << "'\n";
+        exit(1);
+    }
+    if (flock(coalesceLockFd, LOCK_EX | LOCK_NB) != 0)
+    {
+        char holder[32] = { 0 };
+        pread(coalesceLockFd, holder, sizeof(holder) - 1, 0);
+        cout << "\nan identical request (pid " << atoi(holder) << ") is already being carved; waiting for its result\n";
+        TRACE_PROBE1(job__enqueue, key.c_str());
+        flock(coalesceLockFd, LOCK_EX);
+    }
+    TRACE_PROBE1(job__dequeue, key.c_str());
+
+    // whoever held the lock before us may have published; if not, it exited without a result and we carve
+    if (stat(resultFile.c_str(), &status) == 0 && copyFile(resultFile, fileToWrite))
+    {
+        leaveCoalesceGroup();
+        return false;
+    }
+
+    // the holder's pid, for the requests that wait on it
+    string pid = std::to_string(getpid());
+    if (ftruncate(coalesceLockFd, 0) != 0 || pwrite(coalesceLockFd, pid.c_str(), pid.size(), 0) != (ssize_t)pid.size())
+    {
+        cerr << "warning: could not record this process in '" << lockFile << "'\n";
+    }
+    return true;
+}
+
+/// @brief Publish this process's result for the identical requests waiting on it, release the lock and leave
+///        the group.
+/// @param directory The coalescing directory.
+/// @param key The coalescing key (see coalesceKey).
+/// @param fileToWrite The result, already written.
+void coalescePublish(const string &directory, const string &key, const string &fileToWrite)
+{
+    // written under a temporary name and renamed, so no one ever copies a half-written result
+    string resultFile = directory + "/" + key + ".pgm";
+    string partialFile = resultFile + "." + std::to_string(getpid());
+    if (!copyFile(fileToWrite, partialFile) || rename(partialFile.c_str(), resultFile.c_str()) != 0)
+    {
+        cerr << "warning: could not publish the result to '" << directory << "'\n";
+        unlink(partialFile.c_str());
+    }
+
+    leaveCoalesceGroup();
+}
+// #ENDREGION
+
+// #REGION resources
+
+/// @brief Count the CPUs in a cpuset list such as "0-3,8,10-11".
+/// @return The number of CPUs listed, or 0 if the list is empty or malformed.
+int countCpuList(const string &cpuList)
+{
+    int count = 0;
+    stringstream ranges(cpuList);
+    string range;
+    while (getline(ranges, range, ','))
+    {
+        int first = 0, last = 0;
+        char dash = 0;
+        stringstream bounds(range);
+        if (!(bounds >> first))
+        {
+            continue;
+        }
+        last = (bounds >> dash >> last) ? last : first;
+        count += std::max(0, last - first + 1);
+    }
+
+    return count;
+}
+
+/// @brief Read the first line of a file.
+/// @return The line, or an empty string if the file could not be read.
+static string readFirstLine(const string &filename)
+{
+    ifstream in(filename);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+/// @brief Detect the CPU and memory available to this process. Under cgroup v2 this reads cpu.max, 
+///        cpuset.cpus.effective and memory.max of the process's cgroup and each of its ancestors, keeping 
+///        the tightest; under cgroup v1 the equivalent cpu.cfs_quota_us / cpu.cfs_period_us, 
+///        cpuset.effective_cpus and memory.limit_in_bytes. The affinity mask is honored as well.
+/// @return The limits, detected once and then cached.
+const ResourceLimits &detectResourceLimits()
+{
+    static ResourceLimits limits = []()
+    {
+        ResourceLimits detected;
+        detected.cpus = std::max(1u, std::thread::hardware_concurrency());
+        detected.memoryBytes = -1;
+
+        auto limitCpus = [&detected](double cpus)
+        {
+            if (cpus > 0)
+            {
+                detected.cpus = std::max(1, std::min(detected.cpus, (int)std::ceil(cpus)));
+            }
+        };
+        auto limitMemory = [&detected](long long bytes)
+        {
+            if (bytes > 0 && (detected.memoryBytes < 0 || bytes < detected.memoryBytes))
+            {
+                detected.memoryBytes = bytes;
+            }
+        };
+
+        cpu_set_t affinity;
+        if (sched_getaffinity(0, sizeof(affinity), &affinity) == 0)
+        {
+            limitCpus(CPU_COUNT(&affinity));
+        }
+
+        // /proc/self/cgroup lines are "id:controllers:path"; the cgroup v2 line is "0::path"
+        ifstream cgroups("/proc/self/cgroup");
+        string line;
+        while (getline(cgroups, line))
+        {
+            size_t first = line.find(':'), second = line.find(':', first + 1);
+            if (first == string::npos || second == string::npos)
+            {
+                continue;
+            }
+            string controllers = line.substr(first + 1, second - first - 1);
+            string path = line.substr(second + 1);
+
+            // walk from the process's own cgroup up to the root; any level can impose a limit
+            while (true)
+            {
+                if (controllers.empty())
+                {
+                    // cgroup v2, mounted at /sys/fs/cgroup (or at /sys/fs/cgroup/unified on hybrid hosts)
+                    string base = "/sys/fs/cgroup" + (path == "/" ? string() : path);
+                    struct stat status;
+                    if (stat("/sys/fs/cgroup/cgroup.controllers", &status) != 0)
+                    {
+                        base = "/sys/fs/cgroup/unified" + (path == "/" ? string() : path);
+                    }
+
+                    stringstream cpuMax(readFirstLine(base + "/cpu.max"));
+                    string quota;
+                    double period = 0;
+                    if (cpuMax >> quota >> period && quota != "max" && period > 0)
+                    {
+                        limitCpus(atof(quota.c_str()) / period);
+                    }
+                    limitCpus(countCpuList(readFirstLine(base + "/cpuset.cpus.effective")));
+
+                    string memoryMax = readFirstLine(base + "/memory.max");
+                    if (!memoryMax.empty() && memoryMax != "max")
+                    {
+                        limitMemory(atoll(memoryMax.c_str()));
+                    }
+                }
+                else if (controllers.find("cpu") != string::npos || controllers.find("memory") != string::npos)
+                {
+                    // cgroup v1, one hierarchy per controller. an unlimited memory.limit_in_bytes reads as a huge value
+                    string suffix = path == "/" ? string() : path;
+                    if (controllers == "cpu" || controllers.find("cpu,") == 0 || controllers.find(",cpu") != string::npos)
+                    {
+                        double quota = atof(readFirstLine("/sys/fs/cgroup/cpu" + suffix + "/cpu.cfs_quota_us").c_str());
+                        double period = atof(readFirstLine("/sys/fs/cgroup/cpu" + suffix + "/cpu.cfs_period_us").c_str());
+                        if (quota > 0 && period > 0)
+                        {
+                            limitCpus(quota / period);
+                        }
+                    }
+                    if (controllers == "cpuset")
+                    {
+                        limitCpus(countCpuList(readFirstLine("/sys/fs/cgroup/cpuset" + suffix + "/cpuset.effective_cpus")));
+                    }
+                    if (controllers == "memory")
+                    {
+                        long long bytes = atoll(readFirstLine("/sys/fs/cgroup/memory" + suffix + "/memory.limit_in_bytes").c_str());
+                        if (bytes < (1LL << 60))
+                        {
+                            limitMemory(bytes);
+                        }
+                    }
+                }
+
+                if (path.empty() || path == "/")
+                {
+                    break;
+                }
+                size_t parent = path.find_last_of('/');
+                path = parent == 0 ? "/" : path.substr(0, parent);
+            }
+        }
+
+        return detected;
+    }();
+
+    return limits;
+}
+
+/// @brief Estimate the peak memory a carve needs, to refuse one that cannot fit under the memory limit 
+///        up front rather than be killed part-way through.
+/// @param columns Columns of the image.
+/// @param rows Rows of the image.
+/// @param jointCount Number of images carved jointly with it.
+/// @param options The carving options.
+/// @return The estimate, in bytes.
+long long estimateWorkingSet(int columns, int rows, int jointCount, const CarveOptions &options)
+{
+    // one map: a row vector of rows, each row's own header and allocation overhead
+    long long mapBytes = (long long)rows * (columns * sizeof(int) + sizeof(vector<int>) + 16);
+
+    // the image, its energy and cumulative energy maps, a transposed copy, and each joint image
+    long long maps = 4 + jointCount;
+    if (options.interactive || !options.seamIndexDir.empty())
+    {
+        // a session keeps its own image and energy map; the seam index replays on copies of both
+        maps += 2;
+    }
+
+    return maps * mapBytes;
+}
+// #ENDREGION
+
+// #REGION telemetry
+// each carving thread appends to a buffer of its own, so recording never contends on a lock. the buffers are 
+// owned here rather than by their threads, so they outlive the threads until they are written out.
+static std::mutex telemetryMutex;
+static vector<std::unique_ptr<vector<SeamTelemetry>>> telemetryBuffers;
+
+/// @brief The calling thread's telemetry buffer. Only the first call on each thread takes a lock.
+vector<SeamTelemetry> &threadTelemetry()
+{
+    thread_local vector<SeamTelemetry> *buffer = nullptr;
+    if (buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(telemetryMutex);
+        telemetryBuffers.push_back(std::unique_ptr<vector<SeamTelemetry>>(new vector<SeamTelemetry>()));
+        buffer = telemetryBuffers.back().get();
+        buffer->reserve(1024);
+    }
+
+    return *buffer;
+}
+
+/// @brief Record the statistics of a carved seam in the calling thread's telemetry buffer.
+/// @param horizontal Whether the seam was carved from the transposed image.
+/// @param index Seam number within its orientation, from 1.
+/// @param energy Total energy along the seam.
+/// @param seam The seam.
+/// @param previousSeam The seam carved before it in the same orientation, or empty if it is the first.
+/// @param energyCells Energy cells computed for this seam.
+/// @param dpCells Cumulative energy cells computed for this seam.
+/// @param prunedCells Cumulative energy cells skipped as provably unchanged.
+void recordSeamTelemetry(bool horizontal, int index, long long energy, const vector<int> &seam, const vector<int> &previousSeam, 
+                         long long energyCells, long long dpCells, long long prunedCells)
+{
+    vector<SeamTelemetry> &buffer = threadTelemetry();
+
+    SeamTelemetry record;
+    record.thread = 0; // filled in when written
+    record.horizontal = horizontal ? 1 : 0;
+    record.seam = index;
+    record.energy = energy;
+
+    auto extent = std::minmax_element(seam.begin(), seam.end());
+    record.span = *extent.second - *extent.first;
+
+    record.drift = -1;
+    if (previousSeam.size() == seam.size())
+    {
+        record.drift = 0;
+        for (int i = 0; i < seam.size(); ++i)
+        {
+            record.drift = std::max(record.drift, abs(seam[i] - previousSeam[i]));
+        }
+    }
+
+    record.energyCells = energyCells;
+    record.dpCells = dpCells;
+    record.prunedCells = prunedCells;
+    buffer.push_back(record);
+}
+
+/// @brief Write the low 'bytes' bytes of a (two's complement) value, least significant first.
+static void writeLittleEndian(ofstream &out, long long value, int bytes)
+{
+    unsigned long long bits = (unsigned long long)value;
+    for (int k = 0; k < bytes; ++k)
+    {
+        out.put((char)((bits >> (8 * k)) & 0xFF));
+    }
+}
+
+/// @brief Write every thread's telemetry to a file. As csv, one seam per line under a header naming the fields 
+///        of SeamTelemetry; or, if the filename ends in ".bin", as a sequence of packed little-endian records:
+///            int32 thread, horizontal, seam; int64 energy; int32 span, drift; int64 energyCells, dpCells, prunedCells
+/// @param filename Where to write the telemetry.
+void writeTelemetry(const string &filename)
+{
+    bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+    ofstream telemetryFile(filename, binary ? std::ios::binary : std::ios::out);
+    if (!telemetryFile)
+    {
+        cerr << "warning: could not write telemetry to '" << filename << "'\n";
+        return;
+    }
+
+    if (!binary)
+    {
+        telemetryFile << "thread,horizontal,seam,energy,span,drift,energy_cells,dp_cells,pruned_cells\n";
+    }
+
+    std::lock_guard<std::mutex> lock(telemetryMutex);
+    for (int t = 0; t < telemetryBuffers.size(); ++t)
+    {
+        for (SeamTelemetry record : *telemetryBuffers[t])
+        {
+            record.thread = t;
+            if (binary)
+            {
+                // field by field, byte by byte, so the file is the same whatever the host's byte order and padding
+                writeLittleEndian(telemetryFile, record.thread, 4);
+                writeLittleEndian(telemetryFile, record.horizontal, 4);
+                writeLittleEndian(telemetryFile, record.seam, 4);
+                writeLittleEndian(telemetryFile, record.energy, 8);
+                writeLittleEndian(telemetryFile, record.span, 4);
+                writeLittleEndian(telemetryFile, record.drift, 4);
+                writeLittleEndian(telemetryFile, record.energyCells, 8);
+                writeLittleEndian(telemetryFile, record.dpCells, 8);
+                writeLittleEndian(telemetryFile, record.prunedCells, 8);
+            }
+            else
+            {
+                telemetryFile << record.thread << "," << record.horizontal << "," << record.seam << "," << record.energy << "," 
+                              << record.span << "," << record.drift << "," << record.energyCells << "," 
+                              << record.dpCells << "," << record.prunedCells << "\n";
+            }
+        }
+    }
+}
+// #ENDREGION
+
+// #REGION batch
+
+/// @brief Read just the dimensions from the header of a P2 pgm file (see initImageMap for the format).
+/// @return false if the file cannot be opened or its header is not as expected.
+bool readPgmDimensions(const string &filename, int &columns, int &rows)
+{
+    ifstream pgmInputFile(filename);
+    string temp_line;
+    if (!getline(pgmInputFile, temp_line) || temp_line != "P2")
+    {
+        return false;
+    }
+    if (pgmInputFile.peek() == '#')
+    {
+        getline(pgmInputFile, temp_line); // skip optional comment
+    }
+
+    columns = rows = 0;
+    pgmInputFile >> columns >> rows;
+    return columns > 0 && rows > 0;
+}
+
+/// @brief Carve the next seam of a batch job: its vertical seams first, then its horizontal seams.
+/// @param job The job, already loaded, with seams left to carve.
+/// @param options The carving options.
+/// @return The pixel-seams the seam cost: the pixel count of the image it was carved from.
+long long carveBatchSeam(BatchJob &job, const CarveOptions &options)
+{
+    if (job.seamsCarved == job.verticalSeams && !job.transposed)
+    {
+        // transpose the map to reuse the vertical seam carver for horizontal seams. the batch already has a
+        // worker per CPU, so the transpose stays on this one
+        transposeMap(job.imageMap, 1);
+        job.transposed = true;
+        job.previousSeam.clear();
+    }
+
+    long long pixelSeams = (long long)job.imageMap.size() * job.imageMap[0].size();
+
+    TRACE_PROBE3(seam__start, job.transposed ? 1 : 0, job.seamsCarved + 1, (int)job.imageMap[0].size());
+    vector<vector<int>> E;
+    bool cached = !job.energyMap.empty();
+    if (!cached)
+    {
+        E = initEnergyMap(job.imageMap);
+    }
+    else
+    {
+        // the first seam's energy map came from the image cache
+        E.swap(job.energyMap);
+    }
+    vector<int> seam = findLowestEnergySeam(E, options);
+    removeSeam(job.imageMap, seam);
+    ++job.seamsCarved;
+    if (!options.telemetryFile.empty())
+    {
+        // into this worker's buffer, numbered within its orientation as carveSeams numbers them
+        int index = job.transposed ? job.seamsCarved - job.verticalSeams : job.seamsCarved;
+        recordSeamTelemetry(job.transposed, index, seamEnergy(E, seam), seam, job.previousSeam, cached ? 0 : pixelSeams, pixelSeams, 0);
+        job.previousSeam = seam;
+    }
+    TRACE_PROBE2(seam__end, job.transposed ? 1 : 0, job.seamsCarved);
+
+    if (job.seamsCarved == job.verticalSeams + job.horizontalSeams && job.transposed)
+    {
+        transposeMap(job.imageMap, 1); // undo the transpose
+    }
+
+    return pixelSeams;
+}
+
+/// @brief Carve a batch of jobs on behalf of several tenants with weighted fair sharing of worker time.
+///        The manifest has one declaration per line ('#' lines are comments):
+///            tenant NAME WEIGHT [MAX_CONCURRENT [MAX_MEMORY_BYTES]]
+///            job TENANT IMAGE VERTICAL_SEAMS HORIZONTAL_SEAMS
+///        One worker runs per available CPU (see detectResourceLimits). Each turn a worker carves a single 
+///        seam for the tenant with the least pixel-seams served per unit weight, so a tenant's bulk upload 
+///        is preempted at every seam boundary in favor of the others. A tenant's jobs are only started while
+///        it is under its concurrency and memory caps, and all started jobs together stay under the 
+///        process's memory limit. Each result is written to IMAGE_processed_V_H.pgm.
+///        Per-tenant throughput and latency are displayed at the end, and written to 
+///        options.batchStatsFile as csv if it is set.
+/// @param manifest The manifest file.
+/// @param options The carving options, applied to every job.
+void runBatch(const string &manifest, const CarveOptions &options)
+{
+    // each seam is carved by carveBatchSeam, which honors only --bidirectional and --telemetry; the options for 
+    // the single-image path would be silently ignored, so they are refused
+    CarveOptions defaults;
+    const std::pair<bool, const char *> unsupported[] = {
+        { options.interactive, "--interactive" },
+        { !options.energyFile.empty(), "--energy" },
+        { options.energyScale != defaults.energyScale, "--energy-scale" },
+        { options.energyUpdate != defaults.energyUpdate, "--energy-update" },
+        { !options.jointFiles.empty(), "--joint" },
+        { !options.seamIndexDir.empty(), "--seam-index" },
+        { options.seamIndexDistance != defaults.seamIndexDistance, "--seam-index-distance" },
+        { options.seamIndexTolerance != defaults.seamIndexTolerance, "--seam-index-tolerance" },
+        { !options.coalesceDir.empty(), "--coalesce" },
+        { options.profile, "--profile" },
+        { !options.captureDir.empty(), "--capture-dir" },
+        { options.captureFactor != defaults.captureFactor, "--capture-factor" },
+        { options.captureNsPerCell != defaults.captureNsPerCell, "--capture-ns-per-cell" },
+        { !options.coordMapFile.empty(), "--coord-map" },
+        { options.lazyEnergy != defaults.lazyEnergy, "--lazy-energy" },
+        { options.lazyDrift != defaults.lazyDrift, "--lazy-drift" },
+        { options.incrementalDP, "--incremental-dp" }
+    };
+    for (const std::pair<bool, const char *> &option : unsupported)
+    {
+        if (option.first)
+        {
+            cerr << "error: " << option.second << " cannot be combined with --batch, which takes only --bidirectional, "
+                 << "--telemetry, --batch-stats, --image-cache and --cache-energy\n";
+            exit(1);
+        }
+    }
+
+    vector<BatchTenant> tenants;
+    vector<BatchJob> jobs;
+    std::map<string, int> tenantIndex;
+
+    //#REGION parse the manifest
+    ifstream manifestFile(manifest);
+    if (!manifestFile)
+    {
+        cerr << "error: could not open batch manifest '" << manifest << "'\n";
+        exit(1);
+    }
+
+    string line;
+    int lineNumber = 0;
+    while (getline(manifestFile, line))
+    {
+        ++lineNumber;
+        stringstream declaration(line);
+        string kind;
+        if (!(declaration >> kind) || kind[0] == '#')
+        {
+            continue;
+        }
+
+        if (kind == "tenant")
+        {
+            BatchTenant tenant;
+            declaration >> tenant.name >> tenant.weight;
+            if (tenant.name.empty() || tenant.weight <= 0 || tenantIndex.count(tenant.name))
+            {
+                cerr << "error: " << manifest << ":" << lineNumber << ": expected 'tenant NAME WEIGHT' with a new name and a positive weight\n";
+                exit(1);
+            }
+            declaration >> tenant.maxConcurrent >> tenant.maxMemory;
+            tenantIndex[tenant.name] = tenants.size();
+            tenants.push_back(tenant);
+        }
+        else if (kind == "job")
+        {
+            BatchJob job;
+            string tenant;
+            declaration >> tenant >> job.filename >> job.verticalSeams >> job.horizontalSeams;
+            if (!declaration || !tenantIndex.count(tenant))
+            {
+                cerr << "error: " << manifest << ":" << lineNumber << ": expected 'job TENANT IMAGE V H' for a declared tenant\n";
+                exit(1);
+            }
+            job.tenant = tenantIndex[tenant];
+            tenants[job.tenant].queue.push_back(jobs.size());
+            jobs.push_back(job);
+        }
+        else
+        {
+            cerr << "error: " << manifest << ":" << lineNumber << ": unrecognized declaration '" << kind << "'\n";
+            exit(1);
+        }
+    }
+    //#ENDREGION
+
+    const ResourceLimits &limits = detectResourceLimits();
+    ImageCache imageCache(options.imageCacheBytes, options.cacheEnergy);
+    std::mutex schedulerMutex;
+    std::condition_variable schedulerChanged;
+    int jobsLeft = jobs.size();
+    long long memoryInUse = 0;
+    std::chrono::steady_clock::time_point batchStart = std::chrono::steady_clock::now();
+
+    // fail a job that was never started, or whose image could not be loaded (called with the scheduler lock held)
+    auto failJob = [&](int jobIndex, const string &reason)
+    {
+        cerr << "error: batch job '" << jobs[jobIndex].filename << "' skipped: " << reason << "\n";
+        ++tenants[jobs[jobIndex].tenant].failed;
+        --jobsLeft;
+    };
+
+    // choose the next job to carve a seam of, or -1 if none may run right now (called with the scheduler lock held)
+    auto pickJob = [&]() -> int
+    {
+        int best = -1;
+        for (int t = 0; t < tenants.size(); ++t)
+        {
+            BatchTenant &tenant = tenants[t];
+            if (tenant.queue.empty() || (tenant.maxConcurrent > 0 && tenant.running >= tenant.maxConcurrent) 
+                || (best >= 0 && tenants[jobs[best].tenant].virtualTime <= tenant.virtualTime))
+            {
+                continue;
+            }
+
+            for (int jobIndex : tenant.queue)
+            {
+                BatchJob &job = jobs[jobIndex];
+                bool fitsTenant = tenant.maxMemory < 0 || tenant.memoryInUse + job.memory <= tenant.maxMemory;
+                bool fitsProcess = limits.memoryBytes < 0 || memoryInUse + job.memory <= limits.memoryBytes;
+                if (job.started || (fitsTenant && fitsProcess))
+                {
+                    best = jobIndex;
+                    break;
+                }
+            }
+        }
+
+        return best;
+    };
+
+    //#REGION size each job up front
+    for (int jobIndex = 0; jobIndex < jobs.size(); ++jobIndex)
+    {
+        BatchJob &job = jobs[jobIndex];
+        BatchTenant &tenant = tenants[job.tenant];
+        int columns = 0, rows = 0;
+        string problem;
+        if (!readPgmDimensions(job.filename, columns, rows))
+        {
+            problem = "could not read a P2 pgm header";
+        }
+        else if (job.verticalSeams < 0 || job.horizontalSeams < 0 || job.verticalSeams >= columns || job.horizontalSeams >= rows)
+        {
+            problem = "seam counts must be within [0, " + std::to_string(columns - 1) + "] and [0, " + std::to_string(rows - 1) + "]";
+        }
+        else
+        {
+            job.memory = estimateWorkingSet(columns, rows, 0, options);
+            if ((tenant.maxMemory >= 0 && job.memory > tenant.maxMemory) || (limits.memoryBytes >= 0 && job.memory > limits.memoryBytes))
+            {
+                problem = "needs about " + std::to_string(job.memory >> 20) + " MiB, more than its memory cap";
+            }
+        }
+
+        if (!problem.empty())
+        {
+            failJob(jobIndex, problem);
+            tenant.queue.erase(std::find(tenant.queue.begin(), tenant.queue.end(), jobIndex));
+        }
+    }
+    //#ENDREGION
+
+    //#REGION workers
+    auto worker = [&]()
+    {
+        std::unique_lock<std::mutex> lock(schedulerMutex);
+        while (true)
+        {
+            int jobIndex = -1;
+            schedulerChanged.wait(lock, [&]() { return jobsLeft == 0 || (jobIndex = pickJob()) >= 0; });
+            if (jobIndex < 0)
+            {
+                return;
+            }
+
+            // take the job off its tenant's queue and charge it to the tenant
+            BatchJob &job = jobs[jobIndex];
+            BatchTenant &tenant = tenants[job.tenant];
+            tenant.queue.erase(std::find(tenant.queue.begin(), tenant.queue.end(), jobIndex));
+            ++tenant.running;
+            bool starting = !job.started;
+            if (starting)
+            {
+                job.started = true;
+                tenant.memoryInUse += job.memory;
+                memoryInUse += job.memory;
+            }
+            TRACE_PROBE1(job__dequeue, job.filename.c_str());
+            lock.unlock();
+
+            // carve one seam (loading the image first if the job is just starting), then write the result once done
+            string problem;
+            bool loaded = true;
+            if (starting && options.imageCacheBytes > 0)
+            {
+                std::shared_ptr<const CachedImage> cached = imageCache.load(job.filename, problem);
+                loaded = cached != nullptr;
+                if (loaded)
+                {
+                    job.imageMap = cached->imageMap;
+                    if (job.verticalSeams > 0)
+                    {
+                        job.energyMap = cached->energyMap;
+                    }
+                }
+            }
+            else if (starting)
+            {
+                loaded = loadImageMap(job.filename, job.imageMap, problem);
+            }
+            if (!loaded)
+            {
+                // a malformed image fails only its own job; its tenant and the others carry on
+                lock.lock();
+                --tenant.running;
+                tenant.memoryInUse -= job.memory;
+                memoryInUse -= job.memory;
+                failJob(jobIndex, problem.substr(0, problem.find('\n')));
+                schedulerChanged.notify_all();
+                continue;
+            }
+            long long pixelSeams = 0;
+            if (job.seamsCarved < job.verticalSeams + job.horizontalSeams)
+            {
+                pixelSeams = carveBatchSeam(job, options);
+            }
+            bool finished = job.seamsCarved == job.verticalSeams + job.horizontalSeams;
+            if (finished)
+            {
+                writeResults(job.imageMap, processedFilename(job.filename, job.verticalSeams, job.horizontalSeams));
+                vector<vector<int>>().swap(job.imageMap);
+            }
+
+            lock.lock();
+            --tenant.running;
+            tenant.pixelSeams += pixelSeams;
+            tenant.virtualTime += pixelSeams / tenant.weight;
+            if (finished)
+            {
+                tenant.memoryInUse -= job.memory;
+                memoryInUse -= job.memory;
+                tenant.latencies.push_back(secondsSince(batchStart));
+                --jobsLeft;
+            }
+            else
+            {
+                // back to the head of its tenant's queue, so the tenant's started jobs finish before it starts more
+                tenant.queue.push_front(jobIndex);
+                TRACE_PROBE1(job__enqueue, job.filename.c_str());
+            }
+            schedulerChanged.notify_all();
+        }
+    };
+
+    cout << "carving " << jobs.size() << " job(s) for " << tenants.size() << " tenant(s) on " << limits.cpus << " worker(s)\n";
+    vector<std::thread> workers;
+    for (int w = 1; w < limits.cpus; ++w)
+    {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : workers)
+    {
+        thread.join();
+    }
+    double seconds = secondsSince(batchStart);
+    if (!options.telemetryFile.empty())
+    {
+        writeTelemetry(options.telemetryFile);
+    }
+    //#ENDREGION
+
+    //#REGION per-tenant statistics
+    ofstream statsFile;
+    if (!options.batchStatsFile.empty())
+    {
+        statsFile.open(options.batchStatsFile);
+        statsFile << "tenant,weight,jobs,failed,pixel_seams,pixel_seams_per_second,latency_mean,latency_p50,latency_p95,latency_max\n";
+    }
+
+    cout << "\n" << std::left << std::setw(16) << "tenant" << std::setw(8) << "weight" << std::setw(6) << "jobs" 
+         << std::setw(16) << "pixel-seams/s" << std::setw(12) << "mean (s)" << std::setw(12) << "p95 (s)" << "max (s)\n";
+    for (BatchTenant &tenant : tenants)
+    {
+        vector<double> &latencies = tenant.latencies;
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (double latency : latencies)
+        {
+            mean += latency / latencies.size();
+        }
+        auto percentile = [&latencies](double p)
+        {
+            return latencies.empty() ? 0.0 : latencies[std::min<size_t>(latencies.size() - 1, (size_t)(p * latencies.size()))];
+        };
+        double throughput = seconds > 0 ? tenant.pixelSeams / seconds : 0;
+
+        cout << std::setw(16) << tenant.name << std::setw(8) << tenant.weight << std::setw(6) << latencies.size() 
+             << std::setw(16) << (long long)throughput << std::setw(12) << mean << std::setw(12) << percentile(0.95) 
+             << percentile(1.0) << "\n";
+        if (statsFile.is_open())
+        {
+            statsFile << tenant.name << "," << tenant.weight << "," << latencies.size() << "," << tenant.failed << "," 
+                      << tenant.pixelSeams << "," << throughput << "," << mean << "," << percentile(0.5) << "," 
+                      << percentile(0.95) << "," << percentile(1.0) << "\n";
+        }
+    }
+    if (options.imageCacheBytes > 0)
+    {
+        cout << "\nimage cache: " << imageCache.hits() << " hit(s), " << imageCache.misses() << " miss(es)\n";
+    }
+    cout << std::right << "\nEND PROCESSING (" << seconds << "s)\n";
+    //#ENDREGION
+}
+// #ENDREGION
+
+// #REGION image cache
+
+ImageCache::ImageCache(long long maxBytes, bool withEnergy) : maxBytes(maxBytes), withEnergy(withEnergy)
+{
+}
+
+/// @brief Get an image, decoded from the cache if the same file (by path, size and modification time) was
+///        loaded before and is still cached, or parsed with initImageMap and cached otherwise. The least
+///        recently used images are evicted to keep the cache within its byte limit.
+/// @param filename The pgm file.
+/// @param problem Receives what is wrong with the file, if it cannot be loaded.
+/// @return The image (and its energy map, if energy maps are cached), shared with the cache; copy it to carve it.
+///         Null if the file is malformed (see loadImageMap).
+std::shared_ptr<const CachedImage> ImageCache::load(const string &filename, string &problem)
+{
+    // a file rewritten in place gets a new key, so its stale decoding is never served
+    struct stat status;
+    string key;
+    if (stat(filename.c_str(), &status) == 0)
+    {
+        key = filename + ":" + std::to_string((long long)status.st_size) + ":" + std::to_string((long long)status.st_mtim.tv_sec)
+            + "." + std::to_string((long long)status.st_mtim.tv_nsec);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        std::map<string, Entries::iterator>::iterator found = index.find(key);
+        if (!key.empty() && found != index.end())
+        {
+            // move to the front, as the most recently used
+            entries.splice(entries.begin(), entries, found->second);
+            ++hitCount;
+            return found->second->second;
+        }
+        ++missCount;
+    }
+
+    // decoded outside the lock; two workers missing on the same image at once both decode it
+    std::shared_ptr<CachedImage> image = std::make_shared<CachedImage>();
+    if (!loadImageMap(filename, image->imageMap, problem))
+    {
+        return nullptr;
+    }
+    if (withEnergy)
+    {
+        image->energyMap = initEnergyMap(image->imageMap);
+    }
+    size_t rows = image->imageMap.size(), columns = image->imageMap[0].size();
+    image->bytes = (withEnergy ? 2 : 1) * rows * (columns * sizeof(int) + sizeof(vector<int>));
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (key.empty() || image->bytes > maxBytes || index.count(key))
+    {
+        return image;
+    }
+    entries.push_front(std::make_pair(key, std::shared_ptr<const CachedImage>(image)));
+    index[key] = entries.begin();
+    bytes += image->bytes;
+    while (bytes > maxBytes)
+    {
+        // evict the least recently used. images still being copied by a worker live on until it is done
+        bytes -= entries.back().second->bytes;
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    return image;
+}
+
+long long ImageCache::hits() const
+{
+    return hitCount;
+}
+
+long long ImageCache::misses() const
+{
+    return missCount;
+}
+// #ENDREGION
+
+// #REGION atlas
+
+/// @brief Carve a cell of an atlas narrower by cell.seams vertical seams, in place. The cell is a strided view
+///        of the atlas: row i of the cell is atlas[cell.top + i][cell.left, cell.left + cell.columns). Each seam
+///        is chosen exactly as if the cell were an image of its own (its edges are the image's edges), and its
+///        removal shifts the rest of each cell row left within the cell, leaving stale pixels past the new width.
+/// @param atlas The atlas. Only the cell's pixels are modified, so disjoint cells can be carved concurrently.
+/// @param cell The cell. Its width is reduced by the seams carved.
+/// @param energy Scratch space for the energy map, reused between cells.
+/// @param cumulative Scratch space for the cumulative energy map, reused between cells.
+void carveAtlasCell(vector<vector<int>> &atlas, AtlasCell &cell, vector<int> &energy, vector<int> &cumulative)
+{
+    energy.resize((size_t)cell.rows * cell.columns);
+    cumulative.resize((size_t)cell.rows * cell.columns);
+    vector<int> seam(cell.rows);
+
+    for (int s = 0; s < cell.seams; ++s)
+    {
+        int columns = cell.columns;
+
+        //#REGION energy and cumulative energy, row by row, with a stride of the current width
+        for (int i = 0; i < cell.rows; ++i)
+        {
+            const int *row = &atlas[cell.top + i][cell.left];
+            const int *up = i > 0 ? &atlas[cell.top + i - 1][cell.left] : row;
+            const int *down = i + 1 < cell.rows ? &atlas[cell.top + i + 1][cell.left] : row;
+            int *rowEnergy = &energy[(size_t)i * columns];
+            int *rowCumulative = &cumulative[(size_t)i * columns];
+            for (int j = 0; j < columns; ++j)
+            {
+                int left = j > 0 ? row[j - 1] : row[j];
+                int right = j + 1 < columns ? row[j + 1] : row[j];
+                rowEnergy[j] = abs(row[j] - left) + abs(row[j] - right) + abs(row[j] - up[j]) + abs(row[j] - down[j]);
+            }
+
+            if (i == 0)
+            {
+                std::copy(rowEnergy, rowEnergy + columns, rowCumulative);
+                continue;
+            }
+            const int *above = rowCumulative - columns;
+            for (int j = 0; j < columns; ++j)
+            {
+                int best = above[j];
+                if (j > 0)
+                {
+                    best = std::min(best, above[j - 1]);
+                }
+                if (j + 1 < columns)
+                {
+                    best = std::min(best, above[j + 1]);
+                }
+                rowCumulative[j] = rowEnergy[j] + best;
+            }
+        }
+        //#ENDREGION
+
+        //#REGION trace back, taking the leftmost of equal candidates as findSeam does
+        const int *last = &cumulative[(size_t)(cell.rows - 1) * columns];
+        seam[cell.rows - 1] = std::min_element(last, last + columns) - last;
+        for (int i = cell.rows - 1; i > 0; --i)
+        {
+            const int *above = &cumulative[(size_t)(i - 1) * columns];
+            int from = std::max(seam[i] - 1, 0), to = std::min(seam[i] + 1, columns - 1);
+            seam[i - 1] = std::min_element(above + from, above + to + 1) - above;
+        }
+        //#ENDREGION
+
+        for (int i = 0; i < cell.rows; ++i)
+        {
+            int *row = &atlas[cell.top + i][cell.left];
+            std::copy(row + seam[i] + 1, row + columns, row + seam[i]);
+        }
+        --cell.columns;
+    }
+}
+
+/// @brief Carve every cell of a grid-packed atlas by its own number of vertical seams, in parallel and in place,
+///        then write the atlas repacked to the widest carved cell width. Cells carved narrower than that are
+///        padded on the right with 0. The result is written to FILE_processed_K_0.pgm, K the fewest seams
+///        carved from any cell.
+/// @param filename The atlas, a P2 pgm whose width and height are multiples of the cell size.
+/// @param cellColumns Width of each cell.
+/// @param cellRows Height of each cell.
+/// @param seams Seams to carve from each cell: a single number for all of them, or the name of a file of
+///              whitespace separated counts, one per cell in row-major order.
+/// @param options The carving options (--profile is honored).
+void runAtlas(const string &filename, int cellColumns, int cellRows, const string &seams, const CarveOptions &options)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    vector<vector<int>> atlas = initImageMap(filename);
+    int rows = atlas.size(), columns = atlas[0].size();
+    if (cellColumns < 2 || cellRows < 1 || columns % cellColumns != 0 || rows % cellRows != 0)
+    {
+        cerr << "error: the atlas is " << columns << "x" << rows << " pixels, which does not divide into cells of "
+             << cellColumns << "x" << cellRows << "\n";
+        exit(1);
+    }
+    int gridColumns = columns / cellColumns, gridRows = rows / cellRows;
+
+    //#REGION lay out the cells and their seam counts
+    vector<AtlasCell> cells;
+    for (int r = 0; r < gridRows; ++r)
+    {
+        for (int c = 0; c < gridColumns; ++c)
+        {
+            cells.push_back(AtlasCell{ r * cellRows, c * cellColumns, cellColumns, cellRows, atoi(seams.c_str()) });
+        }
+    }
+    if (seams.find_first_not_of("0123456789") != string::npos)
+    {
+        ifstream counts(seams);
+        for (AtlasCell &cell : cells)
+        {
+            if (!(counts >> cell.seams))
+            {
+                cerr << "error: '" << seams << "' must hold one seam count for each of the " << cells.size() << " cells\n";
+                exit(1);
+            }
+        }
+    }
+    int fewestSeams = cellColumns;
+    for (const AtlasCell &cell : cells)
+    {
+        if (cell.seams < 0 || cell.seams >= cellColumns)
+        {
+            cerr << "error: each cell can be carved by 0 to " << cellColumns - 1 << " seams, not " << cell.seams << "\n";
+            exit(1);
+        }
+        fewestSeams = std::min(fewestSeams, cell.seams);
+    }
+    //#ENDREGION
+    double loadSeconds = secondsSince(start);
+
+    //#REGION carve the cells, in parallel
+    start = std::chrono::steady_clock::now();
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        vector<int> energy, cumulative;
+        for (int k = next++; k < cells.size(); k = next++)
+        {
+            carveAtlasCell(atlas, cells[k], energy, cumulative);
+        }
+    };
+
+    int threads = std::max(1, std::min<int>(detectResourceLimits().cpus, cells.size()));
+    vector<std::thread> workers;
+    for (int w = 1; w < threads; ++w)
+    {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : workers)
+    {
+        thread.join();
+    }
+    double carveSeconds = secondsSince(start);
+    //#ENDREGION
+
+    //#REGION repack
+    start = std::chrono::steady_clock::now();
+    int packedColumns = cellColumns - fewestSeams;
+    vector<vector<int>> packed(rows, vector<int>(gridColumns * packedColumns, 0));
+
+    // tiles of the packed atlas, each row of a tile copied a cell at a time from the cells it overlaps
+    runTiles(rows, gridColumns * packedColumns, [&](int top, int left, int tileRows, int tileColumns)
+    {
+        for (int i = top; i < top + tileRows; ++i)
+        {
+            for (int j = left; j < left + tileColumns; )
+            {
+                const AtlasCell &cell = cells[(i / cellRows) * gridColumns + j / packedColumns];
+                int cellLeft = j / packedColumns * packedColumns;
+                int end = std::min(left + tileColumns, cellLeft + packedColumns);
+                int copied = std::max(0, std::min(end, cellLeft + cell.columns) - j);
+                const int *row = &atlas[i][cell.left + j - cellLeft];
+                std::copy(row, row + copied, packed[i].begin() + j);
+                j = end;
+            }
+        }
+    });
+
+    string fileToWrite = processedFilename(filename, fewestSeams, 0);
+    writeResults(packed, fileToWrite);
+    double writeSeconds = secondsSince(start);
+    //#ENDREGION
+
+    cout << "carved " << cells.size() << " cells of " << cellColumns << "x" << cellRows << " into cells of "
+         << packedColumns << "x" << cellRows << "\n";
+    cout << "Results written to '" << fileToWrite << "' \n";
+    if (options.profile)
+    {
+        cout << "\nload " << loadSeconds << " s, carve " << carveSeconds << " s on " << threads << " thread(s), repack and write "
+             << writeSeconds << " s\n";
+    }
+}
+// #ENDREGION
+
+// #REGION bilevel
+
+/// @brief Whether a file is a pbm image (P1 or P4), judged by its magic number.
+bool isPbmFile(const string &filename)
+{
+    ifstream imageFile(filename, std::ios::binary);
+    char magic[2] = { 0, 0 };
+    imageFile.read(magic, 2);
+
+    return imageFile && magic[0] == 'P' && (magic[1] == '1' || magic[1] == '4');
+}
+
+/// @brief Load a pbm image, P1 (ascii) or P4 (raw), into a bit-packed image.
+/// @param filename The pbm file.
+/// @return The image. Exits with an error if the file is not a well-formed pbm image.
+BitImage loadBitImage(const string &filename)
+{
+    ifstream pbmInputFile(filename, std::ios::binary);
+    if (!pbmInputFile)
+    {
+        cerr << "error: could not open file '" << filename << "'\n";
+        exit(1);
+    }
+
+    // header tokens may be separated by any whitespace and '#' comments running to the end of a line
+    auto skipSeparators = [&pbmInputFile]()
+    {
+        while (pbmInputFile && (isspace(pbmInputFile.peek()) || pbmInputFile.peek() == '#'))
+        {
+            if (pbmInputFile.get() == '#')
+            {
+                string comment;
+                getline(pbmInputFile, comment);
+            }
+        }
+    };
+
+    BitImage image;
+    string magic;
+    pbmInputFile >> magic;
+    skipSeparators();
+    pbmInputFile >> image.columns;
+    skipSeparators();
+    pbmInputFile >> image.rows;
+    if (!pbmInputFile || (magic != "P1" && magic != "P4") || image.columns < 1 || image.rows < 1)
+    {
+        cerr << "error: a problem occured in reading the pbm file header of '" << filename << "'\n";
+        exit(1);
+    }
+    image.binary = magic == "P4";
+    image.words = (image.columns + 63) / 64;
+    image.bits.assign((size_t)image.rows * image.words, 0);
+
+    if (image.binary)
+    {
+        // after a single whitespace character, each row is packed 8 pixels to a byte, leftmost in the high bit
+        pbmInputFile.get();
+        int rowBytes = (image.columns + 7) / 8;
+        vector<unsigned char> packed(rowBytes);
+        for (int i = 0; i < image.rows; ++i)
+        {
+            if (!pbmInputFile.read(reinterpret_cast<char *>(packed.data()), rowBytes))
+            {
+                cerr << "error: the pbm file '" << filename << "' ends before its " << image.rows << " rows of pixels\n";
+                exit(1);
+            }
+            uint64_t *row = image.row(i);
+            for (int j = 0; j < image.columns; ++j)
+            {
+                row[j / 64] |= (uint64_t)((packed[j / 8] >> (7 - j % 8)) & 1) << (j % 64);
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < image.rows; ++i)
+        {
+            uint64_t *row = image.row(i);
+            for (int j = 0; j < image.columns; ++j)
+            {
+                skipSeparators();
+                int pixel = pbmInputFile.get();
+                if (pixel != '0' && pixel != '1')
+                {
+                    cerr << "error: the pbm file '" << filename << "' has a pixel other than 0 or 1, or too few pixels\n";
+                    exit(1);
+                }
+                row[j / 64] |= (uint64_t)(pixel - '0') << (j % 64);
+            }
+        }
+    }
+
+    return image;
+}
+
+/// @brief Write a bit-packed image as a pbm file, in the format (P1 or P4) it was read in.
+/// @param image The image.
+/// @param filename The file to write.
+void writeBitImage(const BitImage &image, const string &filename)
+{
+    ofstream pbmOutputFile(filename, std::ios::binary);
+    if (!pbmOutputFile)
+    {
+        cerr << "error: could not write '" << filename << "'\n";
+        exit(1);
+    }
+
+    pbmOutputFile << (image.binary ? "P4" : "P1") << "\n# Processed by Seam Carving Inc.\n" << image.columns << " " << image.rows << "\n";
+    if (image.binary)
+    {
+        vector<unsigned char> packed((image.columns + 7) / 8);
+        for (int i = 0; i < image.rows; ++i)
+        {
+            std::fill(packed.begin(), packed.end(), 0);
+            for (int j = 0; j < image.columns; ++j)
+            {
+                packed[j / 8] |= image.pixel(i, j) << (7 - j % 8);
+            }
+            pbmOutputFile.write(reinterpret_cast<const char *>(packed.data()), packed.size());
+        }
+        return;
+    }
+
+    // plain pbm lines are kept under 70 characters
+    for (int i = 0; i < image.rows; ++i)
+    {
+        for (int j = 0; j < image.columns; ++j)
+        {
+            pbmOutputFile << (image.pixel(i, j) ? '1' : '0') << (j + 1 == image.columns || (j + 1) % 34 == 0 ? '\n' : ' ');
+        }
+    }
+}
+
+/// @brief Compute the energy of every pixel of a bilevel image, the same L1 gradient as pixelEnergy. Each of the
+///        four neighbor differences is one XOR per word of 64 pixels, and the four differences are summed per
+///        pixel by a bitsliced adder into three bit planes, so the whole computation runs 64 pixels at a time
+///        until the planes are unpacked into one byte per pixel.
+/// @param image The image.
+/// @param energyMap Receives the energy (0 to 4) of each pixel, row-major, image.columns to a row.
+void initBitEnergyMap(const BitImage &image, vector<uint8_t> &energyMap)
+{
+    energyMap.resize((size_t)image.rows * image.columns);
+    int words = (image.columns + 63) / 64;
+    int lastBit = (image.columns - 1) % 64;
+
+    for (int i = 0; i < image.rows; ++i)
+    {
+        const uint64_t *row = image.row(i);
+        const uint64_t *up = i > 0 ? image.row(i - 1) : row;     // edge pixels are their own neighbors
+        const uint64_t *down = i + 1 < image.rows ? image.row(i + 1) : row;
+        uint8_t *rowEnergy = &energyMap[(size_t)i * image.columns];
+
+        for (int w = 0; w < words; ++w)
+        {
+            uint64_t pixels = row[w];
+            uint64_t leftNeighbors = (pixels << 1) | (w > 0 ? row[w - 1] >> 63 : pixels & 1);
+            uint64_t rightNeighbors = (pixels >> 1) | (w + 1 < words ? row[w + 1] << 63 : 0);
+
+            uint64_t left = pixels ^ leftNeighbors;
+            uint64_t right = pixels ^ rightNeighbors;
+            uint64_t above = pixels ^ up[w];
+            uint64_t below = pixels ^ down[w];
+            if (w + 1 == words)
+            {
+                right &= ~(1ULL << lastBit); // the last pixel is its own right-hand neighbor
+            }
+
+            // bitsliced sum of the four differences: bit b of (sum4, sum2, sum1) is the energy of pixel 64w + b
+            uint64_t halfSum1 = left ^ right, carry1 = left & right;
+            uint64_t halfSum2 = above ^ below, carry2 = above & below;
+            uint64_t sum1 = halfSum1 ^ halfSum2;
+            uint64_t carry3 = halfSum1 & halfSum2;
+            uint64_t sum2 = carry1 ^ carry2 ^ carry3;
+            uint64_t sum4 = carry1 & carry2; // all four differ; carry3 is then clear
+
+            int bits = w + 1 == words ? lastBit + 1 : 64;
+            uint8_t *out = rowEnergy + 64 * w;
+            for (int b = 0; b < bits; ++b)
+            {
+                out[b] = ((sum1 >> b) & 1) | (((sum2 >> b) & 1) << 1) | (((sum4 >> b) & 1) << 2);
+            }
+        }
+    }
+}
+
+/// @brief Find the lowest energy vertical seam of a bilevel image's energy map. The cumulative energy is held in
+///        Cost, a narrow unsigned integer wide enough for 4 energy per row, so more of it stays in cache; ties are
+///        broken toward the left as in findSeam.
+/// @param energyMap The energy map from initBitEnergyMap.
+/// @param columns Columns of the image.
+/// @param rows Rows of the image.
+/// @param cumulativeEnergyMap Scratch space for the cumulative energy map, reused between seams.
+/// @return Column index of the seam pixel in each row.
+template <typename Cost>
+vector<int> findBitSeam(const vector<uint8_t> &energyMap, int columns, int rows, vector<Cost> &cumulativeEnergyMap)
+{
+    cumulativeEnergyMap.resize((size_t)rows * columns);
+    std::copy(energyMap.begin(), energyMap.begin() + columns, cumulativeEnergyMap.begin());
+    for (int i = 1; i < rows; ++i)
+    {
+        const Cost *above = &cumulativeEnergyMap[(size_t)(i - 1) * columns];
+        const uint8_t *rowEnergy = &energyMap[(size_t)i * columns];
+        Cost *rowCumulative = &cumulativeEnergyMap[(size_t)i * columns];
+        for (int j = 0; j < columns; ++j)
+        {
+            Cost best = above[j];
+            if (j > 0)
+            {
+                best = std::min(best, above[j - 1]);
+            }
+            if (j + 1 < columns)
+            {
+                best = std::min(best, above[j + 1]);
+            }
+            rowCumulative[j] = rowEnergy[j] + best;
+        }
+    }
+
+    vector<int> seam(rows);
+    const Cost *last = &cumulativeEnergyMap[(size_t)(rows - 1) * columns];
+    seam[rows - 1] = std::min_element(last, last + columns) - last;
+    for (int i = rows - 1; i > 0; --i)
+    {
+        const Cost *above = &cumulativeEnergyMap[(size_t)(i - 1) * columns];
+        int from = std::max(seam[i] - 1, 0), to = std::min(seam[i] + 1, columns - 1);
+        seam[i - 1] = std::min_element(above + from, above + to + 1) - above;
+    }
+
+    return seam;
+}
+
+/// @brief Remove a vertical seam from a bilevel image by shifting the bits right of it down by one: within its
+///        word by masking, and across the words after it by a one-bit shift with carry.
+/// @param image The image. Its width is reduced by one.
+/// @param seam Column index of the seam pixel in each row.
+void removeBitSeam(BitImage &image, const vector<int> &seam)
+{
+    int words = (image.columns + 63) / 64;
+    for (int i = 0; i < image.rows; ++i)
+    {
+        uint64_t *row = image.row(i);
+        int w = seam[i] / 64, b = seam[i] % 64;
+
+        uint64_t below = b == 0 ? 0 : row[w] & ((1ULL << b) - 1);
+        uint64_t above = b == 63 ? 0 : (row[w] >> (b + 1)) << b;
+        row[w] = below | above;
+        for (int k = w + 1; k < words; ++k)
+        {
+            row[k - 1] |= (row[k] & 1) << 63;
+            row[k] >>= 1;
+        }
+    }
+    --image.columns;
+}
+
+/// @brief Transpose a bilevel image (see transposeMap), a 64x64 tile of bits at a time (see runTiles).
+BitImage transposeBitImage(const BitImage &image)
+{
+    BitImage result;
+    result.columns = image.rows;
+    result.rows = image.columns;
+    result.binary = image.binary;
+    result.words = (result.columns + 63) / 64;
+    result.bits.assign((size_t)result.rows * result.words, 0);
+
+    // tiles start on word boundaries, so each tile is one word from each of up to 64 rows
+    runTiles(image.rows, image.columns, [&](int top, int left, int tileRows, int tileColumns)
+    {
+        uint64_t block[64] = { 0 };
+        for (int k = 0; k < tileRows; ++k)
+        {
+            block[k] = image.row(top + k)[left / 64];
+        }
+        transposeBits64(block);
+        for (int k = 0; k < tileColumns; ++k)
+        {
+            result.row(left + k)[top / 64] = block[k];
+        }
+    });
+
+    return result;
+}
+
+/// @brief Carve the requested number of vertical, then horizontal, seams out of a bilevel image, choosing the
+///        same seams as carveSeams would for the same image loaded as 0/1 greyscale.
+/// @param image The image. Modified.
+/// @param num_vertical_seams Number of vertical seams to carve.
+/// @param num_horizontal_seams Number of horizontal seams to carve.
+/// @param timings Receives the time spent in the energy, dp and remove stages.
+void carveBitImage(BitImage &image, int num_vertical_seams, int num_horizontal_seams, StageTimings &timings)
+{
+    vector<uint8_t> energyMap;
+    vector<uint16_t> narrowCumulative;
+    vector<uint32_t> wideCumulative;
+    std::chrono::steady_clock::time_point stageStart;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        int seams = pass == 0 ? num_vertical_seams : num_horizontal_seams;
+        if (pass == 1 && seams > 0)
+        {
+            image = transposeBitImage(image); // transpose to reuse the vertical seam carver for horizontal seams
+        }
+
+        // a seam's cumulative energy is at most 4 per row
+        bool narrow = 4LL * image.rows <= std::numeric_limits<uint16_t>::max();
+        for (int i = 1; i <= seams; ++i)
+        {
+            TRACE_PROBE3(seam__start, pass, i, image.columns);
+            stageStart = std::chrono::steady_clock::now();
+            initBitEnergyMap(image, energyMap);
+            timings.energy += secondsSince(stageStart);
+
+            stageStart = std::chrono::steady_clock::now();
+            vector<int> seam = narrow ? findBitSeam(energyMap, image.columns, image.rows, narrowCumulative)
+                                      : findBitSeam(energyMap, image.columns, image.rows, wideCumulative);
+            timings.dp += secondsSince(stageStart);
+
+            stageStart = std::chrono::steady_clock::now();
+            removeBitSeam(image, seam);
+            timings.remove += secondsSince(stageStart);
+            TRACE_PROBE2(seam__end, pass, i);
+        }
+
+        if (pass == 1 && seams > 0)
+        {
+            image = transposeBitImage(image); // undo the transpose
+        }
+    }
+}
+// #ENDREGION
+
+// #REGION retarget store
+
+/// @brief Carve an image narrower one vertical seam at a time, recording which seam removed each pixel.
+/// @param imageMap The image. Not modified.
+/// @param maxSeams Number of seams to carve, at most one less than the image's width.
+/// @return For each pixel (in the original image's coordinates), the number (from 1) of the seam that 
+///         removed it, or RETARGET_KEPT if it survives all maxSeams seams.
+vector<vector<int>> seamRemovalOrder(const vector<vector<int>> &imageMap, int maxSeams)
+{
+    int num_rows = imageMap.size();
+    int num_columns = imageMap[0].size();
+
+    // the original column of each pixel still in the image, carved in lockstep with the image
+    vector<vector<int>> columnOf(num_rows, vector<int>(num_columns));
+    for (int i = 0; i < num_rows; ++i)
+    {
+        for (int j = 0; j < num_columns; ++j)
+        {
+            columnOf[i][j] = j;
+        }
+    }
+
+    vector<vector<int>> removedBy(num_rows, vector<int>(num_columns, RETARGET_KEPT));
+    vector<vector<int>> image(imageMap);
+    vector<vector<int>> energyMap = initEnergyMap(image);
+    for (int k = 1; k <= maxSeams; ++k)
+    {
+        vector<int> seam = findSeam(initCumulativeEnergyMap(energyMap));
+        for (int i = 0; i < num_rows; ++i)
+        {
+            removedBy[i][columnOf[i][seam[i]]] = k;
+        }
+
+        removeSeam(image, seam);
+        removeSeam(columnOf, seam);
+        removeSeam(energyMap, seam);
+        refreshEnergyNearSeam(image, energyMap, seam);
+    }
+
+    return removedBy;
+}
+
+/// @brief pwrite all of a buffer, continuing after short writes and interruptions.
+/// @param fd The file to write.
+/// @param data The bytes to write.
+/// @param bytes How many.
+/// @param offset Where in the file.
+/// @return True if every byte was written.
+static bool pwriteFully(int fd, const void *data, size_t bytes, off_t offset)
+{
+    const char *cursor = (const char *)data;
+    while (bytes > 0)
+    {
+        ssize_t written = pwrite(fd, cursor, bytes, offset);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        cursor += written;
+        bytes -= written;
+        offset += written;
+    }
+
+    return true;
+}
+
+/// @brief Build a retarget store (see RetargetStoreHeader) from a list of images, one per line:
+///            ID IMAGE [MAX_SEAMS]
+///        MAX_SEAMS, the most columns the image can later be narrowed by, defaults to its width less one, 
+///        and may be at most 65534. 
+///        The images are carved in parallel, one worker per available CPU, each writing its image's data 
+///        straight to its precomputed place in the file.
+/// @param storeFile The store to write.
+/// @param listFile The list of images.
+void buildRetargetStore(const string &storeFile, const string &listFile)
+{
+    ifstream list(listFile);
+    if (!list)
+    {
+        cerr << "error: could not open image list '" << listFile << "'\n";
+        exit(1);
+    }
+
+    //#REGION lay out the store
+    vector<RetargetStoreEntry> entries;
+    vector<string> filenames;
+    string line;
+    while (getline(list, line))
+    {
+        stringstream fields(line);
+        string id, filename;
+        if (!(fields >> id >> filename) || id[0] == '#')
+        {
+            continue;
+        }
+
+        RetargetStoreEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        ifstream pgm(filename);
+        int columns = 0, rows = 0, maxPixelValue = 0;
+        string problem;
+        if (id.size() >= sizeof(entry.id) || !parsePgmHeader(pgm, filename, columns, rows, maxPixelValue, problem))
+        {
+            cerr << "error: '" << line << "': ids must be under " << sizeof(entry.id) << " characters, and images P2 pgm files\n";
+            exit(1);
+        }
+        if (maxPixelValue > 0xFFFF)
+        {
+            // pixels are stored as uint16
+            cerr << "error: '" << line << "': the image's maximum value is " << maxPixelValue << ", over the 65535 a store can hold\n";
+            exit(1);
+        }
+        int maxSeams = columns - 1;
+        fields >> maxSeams;
+        if (std::min(maxSeams, columns - 1) >= RETARGET_KEPT)
+        {
+            // seam numbers are stored as uint16, with RETARGET_KEPT reserved
+            cerr << "error: '" << line << "': at most " << RETARGET_KEPT - 1 << " seams can be stored per image; give a smaller MAX_SEAMS\n";
+            exit(1);
+        }
+
+        strcpy(entry.id, id.c_str());
+        entry.width = columns;
+        entry.height = rows;
+        entry.maxSeams = std::max(0, std::min(maxSeams, columns - 1));
+        entries.push_back(entry);
+        filenames.push_back(filename);
+    }
+
+    // the index is sorted by id, for binary search
+    vector<int> order(entries.size());
+    for (int k = 0; k < order.size(); ++k)
+    {
+        order[k] = k;
+    }
+    std::sort(order.begin(), order.end(), [&entries](int a, int b) { return strcmp(entries[a].id, entries[b].id) < 0; });
+    for (int k = 1; k < order.size(); ++k)
+    {
+        if (strcmp(entries[order[k - 1]].id, entries[order[k]].id) == 0)
+        {
+            cerr << "error: image id '" << entries[order[k]].id << "' is listed twice\n";
+            exit(1);
+        }
+    }
+
+    uint64_t offset = sizeof(RetargetStoreHeader) + entries.size() * sizeof(RetargetStoreEntry);
+    for (int k : order)
+    {
+        entries[k].offset = offset;
+        offset += 2 * sizeof(uint16_t) * (uint64_t)entries[k].width * entries[k].height;
+        offset = (offset + 7) & ~(uint64_t)7;
+    }
+    //#ENDREGION
+
+    int fd = ::open(storeFile.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0 || ftruncate(fd, offset) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(storeFile.c_str());
+        }
+        cerr << "error: could not create retarget store '" << storeFile << "'\n";
+        exit(1);
+    }
+
+    //#REGION carve the images, in parallel
+    std::atomic<int> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex problemMutex;
+    auto worker = [&]()
+    {
+        for (int k = next++; k < entries.size(); k = next++)
+        {
+            RetargetStoreEntry &entry = entries[k];
+            vector<vector<int>> image;
+            string problem;
+            if (!loadImageMap(filenames[k], image, problem))
+            {
+                // reported, and the store removed, once the workers are done; exiting here would leave it half written
+                std::lock_guard<std::mutex> guard(problemMutex);
+                cerr << "error: '" << filenames[k] << "': " << problem;
+                failed = true;
+                continue;
+            }
+            vector<vector<int>> removedBy = seamRemovalOrder(image, entry.maxSeams);
+
+            int maxValue = 0;
+            size_t cells = (size_t)entry.width * entry.height;
+            vector<uint16_t> blob(2 * cells);
+            for (int i = 0; i < entry.height; ++i)
+            {
+                for (int j = 0; j < entry.width; ++j)
+                {
+                    blob[(size_t)i * entry.width + j] = image[i][j];
+                    blob[cells + (size_t)i * entry.width + j] = removedBy[i][j];
+                    maxValue = std::max(maxValue, image[i][j]);
+                }
+            }
+            entry.maxValue = maxValue;
+
+            if (!pwriteFully(fd, blob.data(), blob.size() * sizeof(uint16_t), entry.offset))
+            {
+                failed = true;
+            }
+        }
+    };
+
+    vector<std::thread> workers;
+    for (int w = 1; w < detectResourceLimits().cpus; ++w)
+    {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread : workers)
+    {
+        thread.join();
+    }
+    //#ENDREGION
+
+    // the header and index go in last, once every image's maxValue is known
+    RetargetStoreHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "SCSTORE1", 8);
+    header.count = entries.size();
+
+    vector<RetargetStoreEntry> index;
+    for (int k : order)
+    {
+        index.push_back(entries[k]);
+    }
+    size_t indexBytes = index.size() * sizeof(RetargetStoreEntry);
+    if (failed || !pwriteFully(fd, &header, sizeof(header), 0) || !pwriteFully(fd, index.data(), indexBytes, sizeof(header)))
+    {
+        // a store without its header or with an image missing is of no use; leave none rather than a broken one
+        close(fd);
+        unlink(storeFile.c_str());
+        cerr << "error: could not write retarget store '" << storeFile << "'\n";
+        exit(1);
+    }
+    close(fd);
+
+    cout << "stored " << entries.size() << " image(s) in '" << storeFile << "' (" << offset << " bytes)\n";
+}
+
+RetargetStore::RetargetStore() : data(nullptr), size(0), entries(nullptr), count(0)
+{
+}
+
+RetargetStore::~RetargetStore()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<unsigned char *>(data), size);
+    }
+}
+
+/// @brief Map a store file into memory. Nothing is read or parsed beyond the header.
+/// @param filename The store file.
+/// @return false if it cannot be mapped or is not a retarget store.
+bool RetargetStore::open(const string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(RetargetStoreHeader))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    data = static_cast<const unsigned char *>(mapping);
+    size = status.st_size;
+
+    const RetargetStoreHeader *header = reinterpret_cast<const RetargetStoreHeader *>(data);
+    if (memcmp(header->magic, "SCSTORE1", 8) != 0 || sizeof(RetargetStoreHeader) + (size_t)header->count * sizeof(RetargetStoreEntry) > size)
+    {
+        return false;
+    }
+    count = header->count;
+    entries = reinterpret_cast<const RetargetStoreEntry *>(data + sizeof(RetargetStoreHeader));
+
+    return true;
+}
+
+/// @brief Look up an image's index entry by binary search.
+/// @return The entry, or null if the store has no such image.
+const RetargetStoreEntry *RetargetStore::find(const string &id) const
+{
+    const RetargetStoreEntry *end = entries + count;
+    const RetargetStoreEntry *entry = std::lower_bound(entries, end, id, 
+        [](const RetargetStoreEntry &e, const string &key) { return strcmp(e.id, key.c_str()) < 0; });
+
+    return entry != end && id == entry->id ? entry : nullptr;
+}
+
+/// @brief Produce an image from the store at a given width, in one pass over its mapped pixels.
+/// @param id The image's id.
+/// @param width The width wanted, within [width - maxSeams, width] of the stored image.
+/// @param result Receives the image.
+/// @return false if there is no such image or it cannot be produced at that width.
+bool RetargetStore::retarget(const string &id, int width, vector<vector<int>> &result) const
+{
+    const RetargetStoreEntry *entry = find(id);
+    if (entry == nullptr || width > (int)entry->width || width < (int)(entry->width - entry->maxSeams) || width < 1 
+        || entry->offset + 2 * sizeof(uint16_t) * (uint64_t)entry->width * entry->height > size)
+    {
+        return false;
+    }
+
+    // narrowing by k columns keeps exactly the pixels the first k seams did not remove
+    unsigned int k = entry->width - width;
+    size_t cells = (size_t)entry->width * entry->height;
+    const uint16_t *pixels = reinterpret_cast<const uint16_t *>(data + entry->offset);
+    const uint16_t *removedBy = pixels + cells;
+
+    result.assign(entry->height, vector<int>(width));
+    for (int i = 0; i < entry->height; ++i)
+    {
+        const uint16_t *rowPixels = pixels + (size_t)i * entry->width;
+        const uint16_t *rowRemovedBy = removedBy + (size_t)i * entry->width;
+        int *out = result[i].data();
+        for (int j = 0; j < entry->width; ++j)
+        {
+            if (rowRemovedBy[j] > k)
+            {
+                *out++ = rowPixels[j];
+            }
+        }
+    }
+
+    return true;
+}
+// #ENDREGION
+
+// #REGION coordinate map
+
+CoordinateMap::CoordinateMap(int columns, int rows) : sourceColumns(columns), sourceRows(rows), carvedColumns(columns), carvedRows(rows),
+                                                       rowRuns(rows, vector<Run>(1, Run{0, 0}))
+{
+}
+
+/// @brief Record a seam removed from the carved image.
+/// @param horizontal Whether the seam is horizontal, i.e. was carved from the transposed image. All vertical
+///                   seams must come before any horizontal one.
+/// @param seam Column index of the seam pixel in each row (of the transposed image if horizontal).
+void CoordinateMap::removeSeam(bool horizontal, const vector<int> &seam)
+{
+    if (!horizontal)
+    {
+        for (int i = 0; i < seam.size(); ++i)
+        {
+            removeFromLine(rowRuns[i], carvedColumns, seam[i]);
+        }
+        --carvedColumns;
+        return;
+    }
+
+    if (columnRuns.empty())
+    {
+        columnRuns.assign(carvedColumns, vector<Run>(1, Run{0, 0}));
+    }
+    for (int j = 0; j < seam.size(); ++j)
+    {
+        removeFromLine(columnRuns[j], carvedRows, seam[j]);
+    }
+    --carvedRows;
+}
+
+/// @brief Remove one position from a line's runs: the run holding it is trimmed, split or dropped, and every
+///        run after it moves down by one.
+/// @param line The line's runs.
+/// @param length The line's carved length, before the removal.
+/// @param position The carved position removed.
+void CoordinateMap::removeFromLine(vector<Run> &line, int length, int position)
+{
+    int k = std::upper_bound(line.begin(), line.end(), position, [](int p, const Run &run) { return p < run.carved; }) - line.begin() - 1;
+    int runLength = (k + 1 < line.size() ? line[k + 1].carved : length) - line[k].carved;
+    int offset = position - line[k].carved;
+
+    int shiftFrom = k + 1;
+    if (runLength == 1)
+    {
+        line.erase(line.begin() + k);
+        shiftFrom = k;
+    }
+    else if (offset == 0)
+    {
+        ++line[k].source;
+    }
+    else if (offset < runLength - 1)
+    {
+        // split, the second half starting just past the removed position
+        line.insert(line.begin() + k + 1, Run{line[k].source + offset + 1, line[k].carved + offset + 1});
+    }
+    for (int r = shiftFrom; r < line.size(); ++r)
+    {
+        --line[r].carved;
+    }
+}
+
+/// @brief Map a source position through a line's runs.
+/// @param line The line's runs.
+/// @param length The line's carved length.
+/// @param source The source position.
+/// @param carved Receives its carved position or, if it was removed, that of the nearest survivor after it
+///               (before it, at the end of the line).
+/// @return false if the position was removed.
+bool CoordinateMap::lineToCarved(const vector<Run> &line, int length, int source, int &carved)
+{
+    int k = std::upper_bound(line.begin(), line.end(), source, [](int s, const Run &run) { return s < run.source; }) - line.begin() - 1;
+    if (k < 0)
+    {
+        carved = 0;
+        return false;
+    }
+
+    int runLength = (k + 1 < line.size() ? line[k + 1].carved : length) - line[k].carved;
+    if (source < line[k].source + runLength)
+    {
+        carved = line[k].carved + source - line[k].source;
+        return true;
+    }
+    carved = std::min(line[k].carved + runLength, length - 1);
+    return false;
+}
+
+/// @brief Map a carved position back through a line's runs.
+/// @param line The line's runs.
+/// @param carved The carved position.
+/// @return Its source position.
+int CoordinateMap::lineToSource(const vector<Run> &line, int carved)
+{
+    int k = std::upper_bound(line.begin(), line.end(), carved, [](int p, const Run &run) { return p < run.carved; }) - line.begin() - 1;
+    return line[k].source + carved - line[k].carved;
+}
+
+/// @brief Map a point of the source image to the carved image.
+/// @param x Column of the point in the source image.
+/// @param y Row of the point in the source image.
+/// @param carvedX Receives its column in the carved image.
+/// @param carvedY Receives its row in the carved image.
+/// @return false if the pixel was carved away, in which case the nearest surviving pixel is given instead.
+bool CoordinateMap::toCarved(int x, int y, int &carvedX, int &carvedY) const
+{
+    bool kept = lineToCarved(rowRuns[y], carvedColumns, x, carvedX);
+    carvedY = y;
+    if (!columnRuns.empty())
+    {
+        kept = lineToCarved(columnRuns[carvedX], carvedRows, y, carvedY) && kept;
+    }
+
+    return kept;
+}
+
+/// @brief Map a point of the carved image back to the source image.
+/// @param carvedX Column of the point in the carved image.
+/// @param carvedY Row of the point in the carved image.
+/// @param x Receives its column in the source image.
+/// @param y Receives its row in the source image.
+void CoordinateMap::toSource(int carvedX, int carvedY, int &x, int &y) const
+{
+    y = columnRuns.empty() ? carvedY : lineToSource(columnRuns[carvedX], carvedY);
+    x = lineToSource(rowRuns[y], carvedX);
+}
+
+/// @brief Write the map as text: a line 'coordmap W H CARVED_W CARVED_H', then one line per source row and,
+///        if any horizontal seams were carved, one per carved column, each 'N SOURCE CARVED ...' for its N runs.
+/// @param filename The file to write.
+void CoordinateMap::write(const string &filename) const
+{
+    ofstream mapOutputFile(filename);
+    if (!mapOutputFile)
+    {
+        cerr << "error: could not write coordinate map '" << filename << "'\n";
+        exit(1);
+    }
+
+    mapOutputFile << "coordmap " << sourceColumns << " " << sourceRows << " " << carvedColumns << " " << carvedRows << "\n";
+    for (const vector<vector<Run>> *lines : {&rowRuns, &columnRuns})
+    {
+        for (const vector<Run> &line : *lines)
+        {
+            mapOutputFile << line.size();
+            for (const Run &run : line)
+            {
+                mapOutputFile << " " << run.source << " " << run.carved;
+            }
+            mapOutputFile << "\n";
+        }
+    }
+}
+
+/// @brief Read a map written by write.
+/// @param filename The file to read.
+/// @return false if it cannot be read or is not a coordinate map.
+bool CoordinateMap::read(const string &filename)
+{
+    ifstream mapInputFile(filename);
+    string magic;
+    if (!(mapInputFile >> magic >> sourceColumns >> sourceRows >> carvedColumns >> carvedRows) || magic != "coordmap"
+        || sourceRows < 1 || carvedColumns < 1 || carvedRows < 1)
+    {
+        return false;
+    }
+
+    // the per-column lines are there only if horizontal seams were carved
+    rowRuns.assign(sourceRows, vector<Run>());
+    columnRuns.assign(carvedRows < sourceRows ? carvedColumns : 0, vector<Run>());
+    for (vector<vector<Run>> *lines : {&rowRuns, &columnRuns})
+    {
+        for (vector<Run> &line : *lines)
+        {
+            int count = 0;
+            mapInputFile >> count;
+            line.resize(std::max(count, 0));
+            for (Run &run : line)
+            {
+                mapInputFile >> run.source >> run.carved;
+            }
+            if (!mapInputFile || line.empty() || line[0].carved != 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+// #ENDREGION
+
+// #REGION benchmark
+
+/// @brief The carving strategies a benchmark compares: the exact carve first, as the reference for the rest.
+vector<BenchmarkStrategy> benchmarkStrategies()
+{
+    vector<BenchmarkStrategy> strategies;
+    CarveOptions options;
+    strategies.push_back(BenchmarkStrategy{ "exact", options });
+
+    options.bidirectional = true;
+    strategies.push_back(BenchmarkStrategy{ "bidirectional", options });
+    options.bidirectional = false;
+
+    options.incrementalDP = true;
+    strategies.push_back(BenchmarkStrategy{ "incremental-dp", options });
+    options.incrementalDP = false;
+
+    for (int m : { 2, 4, 8, 16, 32 })
+    {
+        options.lazyEnergy = m;
+        strategies.push_back(BenchmarkStrategy{ "lazy-" + std::to_string(m), options });
+    }
+    options.lazyEnergy = 32;
+    options.lazyDrift = 0.1;
+    strategies.push_back(BenchmarkStrategy{ "lazy-32-drift-0.1", options });
+
+    return strategies;
+}
+
+/// @brief The strategies a benchmark is asked to compare that this program has no carving mode for. They are
+///        listed in its results as not implemented, so a chart of them shows the gap rather than omitting it.
+vector<string> unimplementedBenchmarkStrategies()
+{
+    return { "batch-multi-seam", "band-limited", "pyramid", "greedy", "strip-parallel" };
+}
+
+/// @brief Benchmark every carving strategy over a corpus of images against the exact carve: wall time of the
+///        carve, total energy of the seams removed (each measured on the exact energy of the image it was carved
+///        from) relative to the exact carve's, and PSNR and SSIM of the result against the exact result. A row per
+///        image and strategy is written to the csv file, then a row per strategy (image '*') with the mean time
+///        and the mean of each measure over the corpus, flagged if the strategy is on the Pareto frontier of time
+///        against seam energy: no other strategy is at least as fast with no more seam energy. Each row's status
+///        is 'measured', but for a summary row per unimplemented strategy (see unimplementedBenchmarkStrategies).
+/// @param corpus A file listing the images, one pgm file per line ('#' lines are comments).
+/// @param num_vertical_seams Number of vertical seams carved from every image.
+/// @param num_horizontal_seams Number of horizontal seams carved from every image.
+/// @param csvFile The file to write the results to.
+void runBenchmark(const string &corpus, int num_vertical_seams, int num_horizontal_seams, const string &csvFile)
+{
+    ifstream corpusFile(corpus);
+    if (!corpusFile)
+    {
+        cerr << "error: could not open benchmark corpus '" << corpus << "'\n";
+        exit(1);
+    }
+    ofstream csv(csvFile);
+    if (!csv)
+    {
+        cerr << "error: could not write '" << csvFile << "'\n";
+        exit(1);
+    }
+    csv << "image,strategy,seconds,seam_energy,seam_energy_vs_exact,psnr,ssim,pareto,status\n";
+
+    vector<BenchmarkStrategy> strategies = benchmarkStrategies();
+    vector<double> totalSeconds(strategies.size()), totalEnergyRatio(strategies.size());
+    vector<double> totalPsnr(strategies.size()), totalSsim(strategies.size());
+    int images = 0;
+
+    string filename;
+    while (getline(corpusFile, filename))
+    {
+        if (filename.empty() || filename[0] == '#')
         {
-            outFile << imageMap[i][j] << " ";
+            continue;
         }
-        outFile << "\n";
+        int columns = 0, rows = 0;
+        if (!readPgmDimensions(filename, columns, rows) || num_vertical_seams >= columns || num_horizontal_seams >= rows)
+        {
+            cerr << "error: benchmark image '" << filename << "' skipped: not a P2 pgm file large enough for the seams requested\n";
+            continue;
+        }
+        vector<vector<int>> original = initImageMap(filename);
+        ++images;
+
+        vector<vector<int>> exact;
+        long long exactEnergy = 0;
+        for (int k = 0; k < strategies.size(); ++k)
+        {
+            vector<vector<int>> I(original), E;
+            vector<vector<vector<int>>> J;
+            CarveReport report;
+            report.logSeams = true;
+
+            // the per-seam progress carveSeams prints is dropped while it is timed
+            std::streambuf *console = cout.rdbuf(nullptr);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            carveSeams(I, J, E, num_vertical_seams, num_horizontal_seams, strategies[k].options, report);
+            double seconds = secondsSince(start);
+            cout.rdbuf(console);
+            cout.clear();
+
+            long long energy = exactSeamsEnergy(original, report.seams);
+            if (k == 0)
+            {
+                exact = I;
+                exactEnergy = energy;
+            }
+            double energyRatio = exactEnergy > 0 ? (double)energy / exactEnergy : 1.0;
+            double psnr = peakSignalToNoise(I, exact), ssim = structuralSimilarity(I, exact);
+
+            totalSeconds[k] += seconds;
+            totalEnergyRatio[k] += energyRatio;
+            totalPsnr[k] += std::min(psnr, 99.0); // identical results count as 99 dB in the mean
+            totalSsim[k] += ssim;
+            csv << filename << "," << strategies[k].name << "," << seconds << "," << energy << "," << energyRatio << ","
+                << psnr << "," << ssim << ",,measured\n";
+        }
+        cout << "benchmarked '" << filename << "'\n";
+    }
+    if (images == 0)
+    {
+        cerr << "error: the benchmark corpus has no usable images\n";
+        exit(1);
     }
 
-    return;
+    //#REGION summary and Pareto frontier
+    cout << "\n" << std::left << std::setw(20) << "strategy" << std::setw(12) << "seconds" << std::setw(16) << "energy/exact"
+         << std::setw(12) << "PSNR (dB)" << std::setw(10) << "SSIM" << "pareto\n";
+    for (int k = 0; k < strategies.size(); ++k)
+    {
+        double seconds = totalSeconds[k] / images, energyRatio = totalEnergyRatio[k] / images;
+        bool pareto = true;
+        for (int other = 0; other < strategies.size(); ++other)
+        {
+            double otherSeconds = totalSeconds[other] / images, otherRatio = totalEnergyRatio[other] / images;
+            if (other != k && otherSeconds <= seconds && otherRatio <= energyRatio && (otherSeconds < seconds || otherRatio < energyRatio))
+            {
+                pareto = false;
+            }
+        }
+
+        cout << std::setw(20) << strategies[k].name << std::setw(12) << seconds << std::setw(16) << energyRatio
+             << std::setw(12) << totalPsnr[k] / images << std::setw(10) << totalSsim[k] / images << (pareto ? "*" : "") << "\n";
+        csv << "*," << strategies[k].name << "," << seconds << ",," << energyRatio << "," << totalPsnr[k] / images << ","
+            << totalSsim[k] / images << "," << (pareto ? 1 : 0) << ",measured\n";
+    }
+    for (const string &name : unimplementedBenchmarkStrategies())
+    {
+        cout << std::setw(20) << name << "not implemented\n";
+        csv << "*," << name << ",,,,,,,not implemented\n";
+    }
+    cout << std::right << "\n" << images << " image(s); per-image results and the summary written to '" << csvFile << "'\n";
+    //#ENDREGION
+}
+// #ENDREGION
+
+/// @brief The number of energy / cumulative energy cells a carve visits, the unit its predicted cost is measured in.
+/// @param columns Columns of the image, before carving.
+/// @param rows Rows of the image, before carving.
+/// @param num_vertical_seams Number of vertical seams carved.
+/// @param num_horizontal_seams Number of horizontal seams carved.
+/// @return Every cell of the image, summed over each seam at the size the image was when that seam was carved.
+long long predictedCells(int columns, int rows, int num_vertical_seams, int num_horizontal_seams)
+{
+    long long cells = 0;
+    for (int k = 0; k < num_vertical_seams; ++k)
+    {
+        cells += (long long)rows * (columns - k);
+    }
+    for (int k = 0; k < num_horizontal_seams; ++k)
+    {
+        cells += (long long)(columns - num_vertical_seams) * (rows - k);
+    }
+
+    return cells;
+}
+
+/// @brief Record a slow job for offline reproduction, in a new subdirectory of 'directory' holding:
+///            input.pgm   a copy of the input image
+///            energy.*    a copy of the --energy map, if any
+///            joint_K.*   a copy of each --joint image, if any
+///            seam-index/ a copy of the --seam-index directory, if any, as the job found it (main adds the job's own
+///                        seams to the index after the capture)
+///            job.txt     the arguments (naming the copies in place of the original files), the inputs' paths,
+///                        the input's hash, the host profile and the stage timings
+/// @param directory The capture directory. Created if it does not exist.
+/// @param argc Argument count of the job, as given to main.
+/// @param argv Argument vector of the job, as given to main.
+/// @param timings Time spent in each stage.
+/// @param seconds Total time the job took.
+/// @param predictedSeconds Time the job was predicted to take.
+void captureSlowJob(const string &directory, int argc, char* argv[], const StageTimings &timings, double seconds, double predictedSeconds)
+{
+    mkdir(directory.c_str(), 0755);
+    string captureDir = directory + "/" + std::to_string((long long)time(nullptr)) + "_" + std::to_string(getpid());
+    if (mkdir(captureDir.c_str(), 0755) != 0 || !copyFile(argv[1], captureDir + "/input.pgm"))
+    {
+        cerr << "warning: could not capture the slow job to '" << captureDir << "'\n";
+        return;
+    }
+
+    // #REGION copy the other input files
+    // each is named in the arguments by its copy, relative to the capture directory, and by its original path below
+    vector<string> args(argv + 1, argv + argc);
+    vector<string> originals;
+    int joints = 0;
+    for (int i = 3; i + 1 < args.size(); ++i)
+    {
+        string copy;
+        if (args[i] == "--energy" || args[i] == "--joint")
+        {
+            string extension = args[i + 1].find_last_of('.') != string::npos ? args[i + 1].substr(args[i + 1].find_last_of('.')) : "";
+            copy = (args[i] == "--energy" ? string("energy") : "joint_" + std::to_string(++joints)) + extension;
+            if (!copyFile(args[i + 1], captureDir + "/" + copy))
+            {
+                cerr << "warning: could not capture '" << args[i + 1] << "'; the capture refers to it by path\n";
+                continue;
+            }
+        }
+        else if (args[i] == "--seam-index")
+        {
+            copy = "seam-index";
+            copyDirectory(args[i + 1], captureDir + "/" + copy);
+        }
+        else
+        {
+            continue;
+        }
+        originals.push_back(args[i] + " " + args[i + 1]);
+        args[++i] = copy;
+    }
+    // #ENDREGION
+
+    ofstream job(captureDir + "/job.txt");
+
+    // #REGION job
+    // the arguments, one per line, up to the "end" marker
+    job << "args\n";
+    for (const string &arg : args)
+    {
+        job << arg << "\n";
+    }
+    job << "end\n";
+
+    stringstream hexHash;
+    hexHash << std::hex << std::setw(16) << std::setfill('0') << hashFile(argv[1], 14695981039346656037ULL);
+    job << "input " << argv[1] << "\n";
+    job << "input_hash " << hexHash.str() << "\n";
+    for (const string &original : originals)
+    {
+        job << "captured " << original << "\n";
+    }
+    // #ENDREGION
+
+    // #REGION host profile
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname) - 1);
+    job << "host " << hostname << "\n";
+
+    struct utsname system;
+    if (uname(&system) == 0)
+    {
+        job << "kernel " << system.sysname << " " << system.release << " " << system.machine << "\n";
+    }
+
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line))
+    {
+        if (line.compare(0, 10, "model name") == 0)
+        {
+            job << "cpu" << line.substr(line.find(':') + 1) << "\n";
+            break;
+        }
+    }
+    job << "hardware_threads " << std::thread::hardware_concurrency() << "\n";
+    // #ENDREGION
+
+    // #REGION timings (seconds)
+    job << "predicted " << predictedSeconds << "\n";
+    job << "total " << seconds << "\n";
+    job << "load " << timings.load << "\n";
+    job << "energy " << timings.energy << "\n";
+    job << "dp " << timings.dp << "\n";
+    job << "remove " << timings.remove << "\n";
+    job << "write " << timings.write << "\n";
+    // #ENDREGION
+
+    cout << "job took " << seconds << "s against a predicted " << predictedSeconds << "s; captured to '" << captureDir << "'\n";
+}
+
+/// @brief Rerun a job captured by captureSlowJob on its captured inputs, with --profile, so its stage timings 
+///        can be compared against those captured. Nothing outside the capture directory is read or written: the
+///        result, and any coordinate map or telemetry, are written into it; the seam index is looked up in a 
+///        fresh scratch copy of the captured one, so the replay neither sees nor leaves any other state; and
+///        coalescing, which shares state with other invocations, is turned off.
+///        (To sample it with an external profiler, run the replay under it, ex) perf record ./a --replay DIR)
+/// @param directory A capture subdirectory, holding input.pgm and job.txt.
+/// @param executable argv[0], used should /proc/self/exe be unavailable.
+/// @note Does not return: the process is replaced by the rerun job.
+void replayCapturedJob(const string &directory, const char *executable)
+{
+    ifstream job(directory + "/job.txt");
+    if (!job)
+    {
+        cerr << "error: '" << directory << "' is not a captured job (no job.txt)\n";
+        exit(1);
+    }
+
+    // #REGION rebuild the job's arguments
+    // the inputs are swapped for their captured copies, outputs are redirected into the capture directory, and
+    // capturing is turned off so the replay is not itself captured
+    vector<string> args;
+    string line;
+    getline(job, line); // "args"
+    while (getline(job, line) && line != "end")
+    {
+        args.push_back(line);
+    }
+    if (args.size() < 3)
+    {
+        cerr << "error: the captured job in '" << directory << "' is incomplete\n";
+        exit(1);
+    }
+    args[0] = directory + "/input.pgm";
+
+    vector<string> replayArgs(1, executable);
+    for (int i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "--capture-dir" || args[i] == "--capture-factor" || args[i] == "--capture-ns-per-cell" || args[i] == "--coalesce")
+        {
+            ++i; // skip its value too
+            continue;
+        }
+        replayArgs.push_back(args[i]);
+        if (i < 3 || i + 1 >= args.size())
+        {
+            continue;
+        }
+
+        if (args[i] == "--energy" || args[i] == "--joint")
+        {
+            // captured copies are named relative to the capture directory
+            replayArgs.push_back(args[i + 1][0] == '/' ? args[i + 1] : directory + "/" + args[i + 1]);
+            ++i;
+        }
+        else if (args[i] == "--seam-index")
+        {
+            // a scratch copy, so the replay's own lookup and update start from exactly what was captured
+            string scratch = directory + "/replay-seam-index";
+            removeDirectory(scratch);
+            copyDirectory(directory + "/" + args[i + 1], scratch);
+            replayArgs.push_back(scratch);
+            ++i;
+        }
+        else if (args[i] == "--coord-map" || args[i] == "--telemetry")
+        {
+            // kept in the capture directory, under the file's own name, rather than overwriting the original
+            replayArgs.push_back(directory + "/replay_" + args[i + 1].substr(args[i + 1].find_last_of('/') + 1));
+            ++i;
+        }
+    }
+    replayArgs.push_back("--profile");
+    // #ENDREGION
+
+    // show what was captured, for comparison with the replay's profile
+    cout << "captured job:\n";
+    while (getline(job, line))
+    {
+        cout << "    " << line << "\n";
+    }
+    cout << "replaying:";
+    for (const string &arg : replayArgs)
+    {
+        cout << " " << arg;
+    }
+    cout << endl;
+
+    vector<char *> replayArgv;
+    for (string &arg : replayArgs)
+    {
+        replayArgv.push_back(&arg[0]);
+    }
+    replayArgv.push_back(nullptr);
+
+    execv("/proc/self/exe", replayArgv.data());
+    execv(executable, replayArgv.data());
+    cerr << "error: could not rerun '" << executable << "' for the replay\n";
+    exit(1);
+}
+
+/// @brief Display the time spent in each stage of a job.
+/// @param timings Time spent in each stage.
+/// @param seconds Total time the job took.
+void displayTimings(const StageTimings &timings, double seconds)
+{
+    cout << "\nprofile (seconds):\n"
+         << "    load     " << timings.load << "\n"
+         << "    energy   " << timings.energy << "\n"
+         << "    dp       " << timings.dp << "\n"
+         << "    remove   " << timings.remove << "\n"
+         << "    write    " << timings.write << "\n"
+         << "    total    " << seconds << "\n";
+}
+
+/// @brief Begin a session on an image. The energy map is maintained from here on rather than recomputed.
+/// @param imageMap The image to carve.
+/// @param energyMap Its energy map, either from initEnergyMap or precomputed (see CarveOptions::energyFile).
+/// @param options Options selecting how new seams are found and how the energy map is updated.
+CarvingSession::CarvingSession(const vector<vector<int>> &imageMap, const vector<vector<int>> &energyMap, const CarveOptions &options)
+    : imageMap(imageMap), energyMap(energyMap), options(options), fullWidth(imageMap[0].size())
+{
+}
+
+/// @brief Current width of the session's image.
+int CarvingSession::width() const
+{
+    return imageMap[0].size();
+}
+
+/// @brief Width of the image the session began with.
+int CarvingSession::originalWidth() const
+{
+    return fullWidth;
+}
+
+/// @brief The session's image at its current width.
+const vector<vector<int>> &CarvingSession::image() const
+{
+    return imageMap;
+}
+
+/// @brief Narrow the image by one seam. If grow put seams back, the most recent of those is removed again 
+///        as-is; otherwise a new seam is found from the maintained cumulative energy map.
+/// @note New seams are only ever carved from the narrowest image so far, so the cumulative energy map is kept
+///       for that image alone: grow and the re-removal of seams leave it as it is, and once every seam put back
+///       has been re-removed the image and energy map are exactly as they were when it was last repaired.
+void CarvingSession::shrink()
+{
+    if (!redoSeams.empty())
+    {
+        // the image is exactly as it was before this seam was first carved, so it is still the one to carve
+        remove(redoSeams.back());
+        redoSeams.pop_back();
+        return;
+    }
+
+    // the first new seam computes the cumulative energy map in full; each one after it repairs it (see
+    // repairCumulativeEnergyMap), so the same seam is found as a full DP would find
+    if (cumulativeEnergyMap.empty())
+    {
+        cumulativeEnergyMap = initCumulativeEnergyMap(energyMap);
+    }
+    RemovedSeam seam;
+    seam.columns = findSeam(cumulativeEnergyMap);
+    remove(seam);
+    removeSeam(cumulativeEnergyMap, seam.columns);
+    repairCumulativeEnergyMap(energyMap, cumulativeEnergyMap, seam.columns);
+}
+
+/// @brief Widen the image by one seam, restoring the original pixels of the most recently carved seam.
+/// @return false if the image is already at its original width.
+bool CarvingSession::grow()
+{
+    if (undoSeams.empty())
+    {
+        return false;
+    }
+
+    RemovedSeam seam = undoSeams.back();
+    undoSeams.pop_back();
+
+    insertSeam(imageMap, seam.columns, seam.pixels);
+    insertSeam(energyMap, seam.columns, seam.energy);
+
+    // the neighbors get back exactly the energy they had, however remove updated it: recomputing a blended
+    // map's neighbors would blend them a second time, and they would drift with every undo and redo
+    for (int i = 0; i < energyMap.size(); ++i)
+    {
+        int low = 0, high = 0;
+        seamNeighborhood(seam.columns, i, energyMap[i].size() - 1, low, high);
+        for (int j = low; j <= high; ++j)
+        {
+            // the saved span is in the columns of the carved row, which shift right of the restored seam pixel
+            energyMap[i][j < seam.columns[i] ? j : j + 1] = seam.neighborEnergy[i][j - low];
+        }
+    }
+
+    redoSeams.push_back(seam);
+    return true;
+}
+
+/// @brief Shrink or grow, one seam at a time, until the image is the requested width.
+/// @param width The target width, in [1, originalWidth()].
+void CarvingSession::resize(int width)
+{
+    while (this->width() > width)
+    {
+        shrink();
+    }
+    while (this->width() < width && grow())
+    {
+    }
+}
+
+/// @brief Carve a seam out of the image and energy maps, remembering its pixels, and the energy of its neighbors
+///        before they are updated, for grow.
+/// @param seam The seam to carve. Only its columns are read.
+void CarvingSession::remove(const RemovedSeam &seam)
+{
+    RemovedSeam removed;
+    removed.columns = seam.columns;
+    removed.pixels = extractSeam(imageMap, seam.columns);
+    removed.energy = extractSeam(energyMap, seam.columns);
+    removed.neighborEnergy.resize(energyMap.size());
+    for (int i = 0; i < energyMap.size(); ++i)
+    {
+        int low = 0, high = 0;
+        seamNeighborhood(seam.columns, i, energyMap[i].size(), low, high);
+        removed.neighborEnergy[i].assign(energyMap[i].begin() + low, energyMap[i].begin() + high + 1);
+    }
+    refreshEnergyNearSeam(imageMap, energyMap, seam.columns, options.energyFile.empty() ? ENERGY_RECOMPUTE : options.energyUpdate);
+
+    undoSeams.push_back(removed);
+}
+
+/// @brief Drive a CarvingSession from commands read on stdin, one per line:
+///            width N      resize the image to N columns (seams are carved or restored as needed)
+///            write FILE   write the image at its current width to FILE
+///            quit         end the session
+/// @param imageMap The image to carve.
+/// @param energyMap Its energy map.
+/// @param num_vertical_seams Seams to carve before the first command is read.
+/// @param options Options selecting how new seams are found.
+void runInteractiveSession(const vector<vector<int>> &imageMap, const vector<vector<int>> &energyMap, int num_vertical_seams, const CarveOptions &options)
+{
+    CarvingSession session(imageMap, energyMap, options);
+    session.resize(session.originalWidth() - num_vertical_seams);
+    cout << "width " << session.width() << endl;
+
+    string line;
+    while (getline(std::cin, line))
+    {
+        stringstream command(line);
+        string verb;
+        command >> verb;
+
+        if (verb == "width")
+        {
+            int width = 0;
+            command >> width;
+            if (width < 1 || width > session.originalWidth())
+            {
+                cerr << "error: width must be within [1, " << session.originalWidth() << "]\n";
+                continue;
+            }
+            session.resize(width);
+            cout << "width " << session.width() << endl;
+        }
+        else if (verb == "write")
+        {
+            string filename;
+            command >> filename;
+            writeResults(session.image(), filename);
+            cout << "wrote '" << filename << "'" << endl;
+        }
+        else if (verb == "quit")
+        {
+            break;
+        }
+        else if (!verb.empty())
+        {
+            cerr << "error: unrecognized command '" << verb << "' (expected width, write or quit)\n";
+        }
+    }
+}
+
+/// @brief Parse the optional flags which follow the three positional command-line arguments.
+/// @param argc Argument count, as given to main.
+/// @param argv Argument vector, as given to main.
+/// @param first Index of the first flag in argv.
+/// @return The options requested on the command line. Anything not requested keeps its default.
+CarveOptions parseCarveOptions(int argc, char* argv[], int first)
+{
+    CarveOptions options;
+
+    for (int i = first; i < argc; ++i)
+    {
+        string flag = argv[i];
+
+        if (flag == "--bidirectional")
+        {
+            options.bidirectional = true;
+        }
+        else if (flag == "--interactive")
+        {
+            options.interactive = true;
+        }
+        else if (flag == "--joint" && i + 1 < argc)
+        {
+            options.jointFiles.push_back(argv[++i]);
+        }
+        else if (flag == "--seam-index" && i + 1 < argc)
+        {
+            options.seamIndexDir = argv[++i];
+        }
+        else if (flag == "--seam-index-distance" && i + 1 < argc)
+        {
+            options.seamIndexDistance = atoi(argv[++i]);
+        }
+        else if (flag == "--seam-index-tolerance" && i + 1 < argc)
+        {
+            options.seamIndexTolerance = atof(argv[++i]);
+        }
+        else if (flag == "--coalesce" && i + 1 < argc)
+        {
+            options.coalesceDir = argv[++i];
+        }
+        else if (flag == "--profile")
+        {
+            options.profile = true;
+        }
+        else if (flag == "--capture-dir" && i + 1 < argc)
+        {
+            options.captureDir = argv[++i];
+        }
+        else if (flag == "--capture-factor" && i + 1 < argc)
+        {
+            options.captureFactor = atof(argv[++i]);
+        }
+        else if (flag == "--capture-ns-per-cell" && i + 1 < argc)
+        {
+            options.captureNsPerCell = atof(argv[++i]);
+        }
+        else if (flag == "--telemetry" && i + 1 < argc)
+        {
+            options.telemetryFile = argv[++i];
+        }
+        else if (flag == "--batch-stats" && i + 1 < argc)
+        {
+            options.batchStatsFile = argv[++i];
+        }
+        else if (flag == "--coord-map" && i + 1 < argc)
+        {
+            options.coordMapFile = argv[++i];
+        }
+        else if (flag == "--image-cache" && i + 1 < argc)
+        {
+            options.imageCacheBytes = atoll(argv[++i]);
+        }
+        else if (flag == "--cache-energy")
+        {
+            options.cacheEnergy = true;
+        }
+        else if (flag == "--lazy-energy" && i + 1 < argc)
+        {
+            options.lazyEnergy = atoi(argv[++i]);
+        }
+        else if (flag == "--lazy-drift" && i + 1 < argc)
+        {
+            options.lazyDrift = atof(argv[++i]);
+        }
+        else if (flag == "--incremental-dp")
+        {
+            options.incrementalDP = true;
+        }
+        else if (flag == "--energy" && i + 1 < argc)
+        {
+            options.energyFile = argv[++i];
+        }
+        else if (flag == "--energy-scale" && i + 1 < argc)
+        {
+            options.energyScale = atof(argv[++i]);
+        }
+        else if (flag == "--energy-update" && i + 1 < argc)
+        {
+            string mode = argv[++i];
+            if (mode == "freeze")
+            {
+                options.energyUpdate = ENERGY_FREEZE;
+            }
+            else if (mode == "blend")
+            {
+                options.energyUpdate = ENERGY_BLEND;
+            }
+            else
+            {
+                cerr << "error: --energy-update must be 'freeze' or 'blend', not '" << mode << "'\n";
+                exit(1);
+            }
+        }
+        else
+        {
+            cerr << "error: unrecognized option '" << flag << "'\n";
+            exit(1);
+        }
+    }
+
+    return options;
 }
@@ -0,0 +1,26 @@
+#!/bin/sh
+# A captured --seam-index job must replay the full carve: the capture holds the seam index as the job found
+# it, not with the job's own seams added, which the replay would otherwise find and reuse.
+# usage: replay_seam_index.sh PATH_TO_a
+set -e
+a="$1"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+# a 24x16 test image
+awk 'BEGIN { print "P2"; print "24 16"; print "255";
+             for (i = 0; i < 16; ++i) { line = ""; for (j = 0; j < 24; ++j) line = line " " (i * 37 + j * j * 11) % 256; print line } }' > input.pgm
+
+# a predicted cost of 0 ns per cell makes every job slow enough to capture
+"$a" input.pgm 4 2 --seam-index index --capture-dir captures --capture-ns-per-cell 0 > job.log
+grep -q "captured to" job.log || { echo "FAIL: the job was not captured"; exit 1; }
+test -s index/index.txt || { echo "FAIL: the job's seams were not added to the seam index"; exit 1; }
+
+"$a" --replay captures/* > replay.log 2>&1
+if grep -q "near-duplicate found" replay.log; then
+    echo "FAIL: the replay found the job's own seams in the captured seam index"
+    exit 1
+fi
+awk '$1 == "dp" && $2 > 0 { found = 1 } END { exit !found }' replay.log || { echo "FAIL: the replay ran no DP"; exit 1; }
+echo "PASS"